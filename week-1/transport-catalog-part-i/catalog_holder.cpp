@@ -0,0 +1,55 @@
+#include "catalog_holder.h"
+
+#include "descriptions.h"
+#include "requests.h"
+#include "thread_pool.h"
+
+using namespace std;
+
+namespace {
+
+CatalogHolder::Snapshot MakeCatalog(
+    vector<Descriptions::InputQuery> descriptions,
+    const Json::Dict& input_map, const Json::Dict& serving_settings,
+    ThreadPool& pool) {
+  return make_shared<const TransportCatalog>(
+      move(descriptions), input_map.at("routing_settings").AsMap(),
+      input_map.at("render_settings").AsMap(), serving_settings, pool);
+}
+
+}  // namespace
+
+CatalogHolder::CatalogHolder(Snapshot catalog) : catalog_(move(catalog)) {}
+
+CatalogHolder::Snapshot CatalogHolder::Acquire() const {
+  return atomic_load_explicit(&catalog_, memory_order_acquire);
+}
+
+void CatalogHolder::Publish(Snapshot catalog) {
+  atomic_store_explicit(&catalog_, move(catalog), memory_order_release);
+}
+
+future<void> CatalogHolder::Refresh(Json::Document input) {
+  return async(launch::async, [this, input = move(input)]() mutable {
+    Publish(Build(move(input).TakeRoot().TakeMap()));
+  });
+}
+
+// static
+CatalogHolder::Snapshot CatalogHolder::Build(const Json::Dict& input_map) {
+  const Json::Dict serving_settings = Requests::GetServingSettings(input_map);
+  ThreadPool pool(Requests::ReadWorkerCount(serving_settings));
+  return MakeCatalog(
+      Descriptions::ReadDescriptions(input_map.at("base_requests").AsArray(),
+                                     pool),
+      input_map, serving_settings, pool);
+}
+
+// static
+CatalogHolder::Snapshot CatalogHolder::Build(Json::Dict&& input_map) {
+  const Json::Dict serving_settings = Requests::GetServingSettings(input_map);
+  ThreadPool pool(Requests::ReadWorkerCount(serving_settings));
+  auto descriptions = Descriptions::ReadDescriptions(
+      move(input_map.at("base_requests")).TakeArray(), pool);
+  return MakeCatalog(move(descriptions), input_map, serving_settings, pool);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <future>
+#include <memory>
+
+#include "json.h"
+#include "transport_catalog.h"
+
+// Keeps the current catalog snapshot of a long-lived process.
+// Readers take the snapshot without locks and keep using it while
+// a fresh one is published; the old snapshot is freed by its last reader.
+class CatalogHolder {
+ public:
+  using Snapshot = std::shared_ptr<const TransportCatalog>;
+
+  explicit CatalogHolder(Snapshot catalog);
+
+  Snapshot Acquire() const;
+  void Publish(Snapshot catalog);
+
+  // Builds a catalog from base_requests, routing_settings and
+  // render_settings of the input in background and publishes it.
+  // The future is ready once it is published and rethrows build errors;
+  // its destructor waits for the build, as for any std::async
+  [[nodiscard]] std::future<void> Refresh(Json::Document input);
+
+  static Snapshot Build(const Json::Dict& input_map);
+  // Moves base_requests out of the input instead of copying it
+  static Snapshot Build(Json::Dict&& input_map);
+
+ private:
+  Snapshot catalog_;
+};
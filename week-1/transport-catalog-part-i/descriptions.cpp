@@ -1,72 +1,268 @@
 #include "descriptions.h"
 
+#include "json_sax.h"
+
 using namespace std;
 
 namespace Descriptions {
 
-Stop Stop::ParseFrom(const Json::Dict& attrs) {
-  Stop stop = {.name = attrs.at("name").AsString(),
+namespace {
+
+vector<string> CompleteRoute(vector<string> stops, bool is_roundtrip) {
+  if (is_roundtrip || stops.size() <= 1) {
+    return stops;
+  }
+  stops.reserve(stops.size() * 2 - 1);  // end stop is not repeated
+  for (size_t stop_idx = stops.size() - 1; stop_idx > 0; --stop_idx) {
+    stops.push_back(stops[stop_idx - 1]);
+  }
+  return stops;
+}
+
+// Json and JsonView nodes have the same accessors.
+// Non-const Json nodes are consumed: strings and arrays are moved out
+
+template <typename Node>
+string ReadString(const Node& node) {
+  return string(node.AsString());
+}
+
+string ReadString(Json::Node& node) { return move(node).TakeString(); }
+
+template <typename Node>
+decltype(auto) ReadArray(const Node& node) {
+  return node.AsArray();
+}
+
+Json::Array ReadArray(Json::Node& node) { return move(node).TakeArray(); }
+
+template <typename Dict>
+Stop ParseStop(Dict& attrs) {
+  Stop stop = {.name = ReadString(attrs.at("name")),
                .position = {
                    .latitude = attrs.at("latitude").AsDouble(),
                    .longitude = attrs.at("longitude").AsDouble(),
                }};
   if (attrs.count("road_distances") > 0) {
-    for (const auto& [neighbour_stop, distance_node] :
-         attrs.at("road_distances").AsMap()) {
-      stop.distances[neighbour_stop] = distance_node.AsInt();
+    const auto& distances = attrs.at("road_distances").AsMap();
+    stop.distances.reserve(distances.size());
+    for (const auto& [neighbour_stop, distance_node] : distances) {
+      stop.distances.emplace_back(neighbour_stop, distance_node.AsInt());
     }
   }
   return stop;
 }
 
-vector<string> ParseStops(const vector<Json::Node>& stop_nodes,
-                          bool is_roundtrip) {
+template <typename Nodes>
+vector<string> ParseStopNames(Nodes& stop_nodes, bool is_roundtrip) {
   vector<string> stops;
   stops.reserve(stop_nodes.size());
-  for (const Json::Node& stop_node : stop_nodes) {
-    stops.push_back(stop_node.AsString());
+  for (auto& stop_node : stop_nodes) {
+    stops.push_back(ReadString(stop_node));
   }
-  if (is_roundtrip || stops.size() <= 1) {
-    return stops;
-  }
-  stops.reserve(stops.size() * 2 - 1);  // end stop is not repeated
-  for (size_t stop_idx = stops.size() - 1; stop_idx > 0; --stop_idx) {
-    stops.push_back(stops[stop_idx - 1]);
+  return CompleteRoute(move(stops), is_roundtrip);
+}
+
+template <typename Dict>
+Bus ParseBus(Dict& attrs) {
+  const bool is_roundtrip = attrs.at("is_roundtrip").AsBool();
+  auto&& stop_nodes = ReadArray(attrs.at("stops"));
+  return Bus{
+      .name = ReadString(attrs.at("name")),
+      .stops = ParseStopNames(stop_nodes, is_roundtrip),
+      .is_roundtrip = is_roundtrip,
+  };
+}
+
+template <typename Node>
+InputQuery ReadDescription(const Node& node) {
+  const auto& node_dict = node.AsMap();
+  if (node_dict.at("type").AsString() == "Bus") {
+    return Bus::ParseFrom(node_dict);
+  } else {
+    return Stop::ParseFrom(node_dict);
   }
-  return stops;
 }
 
-int ComputeStopsDistance(const Stop& lhs, const Stop& rhs) {
-  if (auto it = lhs.distances.find(rhs.name); it != lhs.distances.end()) {
-    return it->second;
+InputQuery ReadDescription(Json::Node&& node) {
+  Json::Dict node_dict = move(node).TakeMap();
+  if (node_dict.at("type").AsString() == "Bus") {
+    return Bus::ParseFrom(move(node_dict));
   } else {
-    return rhs.distances.at(lhs.name);
+    return Stop::ParseFrom(move(node_dict));
   }
 }
 
-Bus Bus::ParseFrom(const Json::Dict& attrs) {
-  return Bus{
-      .name = attrs.at("name").AsString(),
-      .stops = ParseStops(attrs.at("stops").AsArray(),
-                          attrs.at("is_roundtrip").AsBool()),
-      .is_roundtrip = attrs.at("is_roundtrip").AsBool(),
-  };
+// Collects the base_requests array event by event.
+// Fields may come in any order, "type" included
+class DescriptionsHandler : public Json::Handler {
+ public:
+  DescriptionsHandler() {
+    fields_.Bind("type", &type_)
+        .Bind("name", &stop_.name)
+        .Bind("latitude", &stop_.position.latitude)
+        .Bind("longitude", &stop_.position.longitude)
+        .Bind("is_roundtrip", &bus_.is_roundtrip);
+  }
+
+  DescriptionsHandler(const DescriptionsHandler&) = delete;
+
+  void OnStartObject() {
+    if (++depth_ == kDescriptionDepth) {
+      type_.clear();
+      stop_ = {};
+      bus_ = {};
+    }
+  }
+
+  void OnEndObject() {
+    if (depth_-- != kDescriptionDepth) {
+      return;
+    }
+    if (type_ == "Bus") {
+      bus_.name = move(stop_.name);
+      bus_.stops = CompleteRoute(move(bus_.stops), bus_.is_roundtrip);
+      result_.push_back(move(bus_));
+    } else {
+      result_.push_back(move(stop_));
+    }
+  }
+
+  void OnStartArray() { ++depth_; }
+  void OnEndArray() { --depth_; }
+
+  void OnKey(string_view key) {
+    if (depth_ == kDescriptionDepth) {
+      key_ = key;
+    } else if (depth_ == kDescriptionDepth + 1) {
+      neighbour_stop_ = key;
+    }
+  }
+
+  void OnString(string_view value) {
+    if (depth_ == kDescriptionDepth) {
+      fields_.Set(key_, value);
+    } else if (depth_ == kDescriptionDepth + 1 && key_ == "stops") {
+      bus_.stops.emplace_back(value);
+    }
+  }
+
+  void OnNumber(Json::Number value) {
+    if (depth_ == kDescriptionDepth) {
+      fields_.Set(key_, value);
+    } else if (depth_ == kDescriptionDepth + 1 && key_ == "road_distances") {
+      stop_.distances.emplace_back(neighbour_stop_,
+                                   Json::NarrowInt(get<int64_t>(value)));
+    }
+  }
+
+  void OnBool(bool value) {
+    if (depth_ == kDescriptionDepth) {
+      fields_.Set(key_, value);
+    }
+  }
+
+  vector<InputQuery> GetResult() { return move(result_); }
+
+ private:
+  // of the objects in the array
+  static const int kDescriptionDepth = 2;
+
+  int depth_ = 0;
+  string key_;
+  string neighbour_stop_;
+  string type_;
+  Stop stop_;
+  Bus bus_;
+  Json::FieldSet fields_;
+  vector<InputQuery> result_;
+};
+
+}  // namespace
+
+Stop Stop::ParseFrom(const Json::Dict& attrs) { return ParseStop(attrs); }
+
+Stop Stop::ParseFrom(Json::Dict&& attrs) { return ParseStop(attrs); }
+
+Stop Stop::ParseFrom(const JsonView::Object& attrs) {
+  return ParseStop(attrs);
 }
 
+vector<string> ParseStops(const vector<Json::Node>& stop_nodes,
+                          bool is_roundtrip) {
+  return ParseStopNames(stop_nodes, is_roundtrip);
+}
+
+vector<string> ParseStops(vector<Json::Node>&& stop_nodes,
+                          bool is_roundtrip) {
+  return ParseStopNames(stop_nodes, is_roundtrip);
+}
+
+Bus Bus::ParseFrom(const Json::Dict& attrs) { return ParseBus(attrs); }
+
+Bus Bus::ParseFrom(Json::Dict&& attrs) { return ParseBus(attrs); }
+
+Bus Bus::ParseFrom(const JsonView::Object& attrs) { return ParseBus(attrs); }
+
 vector<InputQuery> ReadDescriptions(const vector<Json::Node>& nodes) {
   vector<InputQuery> result;
   result.reserve(nodes.size());
 
   for (const Json::Node& node : nodes) {
-    const auto& node_dict = node.AsMap();
-    if (node_dict.at("type").AsString() == "Bus") {
-      result.push_back(Bus::ParseFrom(node_dict));
-    } else {
-      result.push_back(Stop::ParseFrom(node_dict));
-    }
+    result.push_back(ReadDescription(node));
   }
 
   return result;
 }
 
+vector<InputQuery> ReadDescriptions(vector<Json::Node>&& nodes) {
+  vector<InputQuery> result;
+  result.reserve(nodes.size());
+
+  for (Json::Node& node : nodes) {
+    result.push_back(ReadDescription(move(node)));
+  }
+
+  return result;
+}
+
+vector<InputQuery> ReadDescriptions(const JsonView::Array& nodes) {
+  vector<InputQuery> result;
+  result.reserve(nodes.size());
+
+  for (const JsonView::Node& node : nodes) {
+    result.push_back(ReadDescription(node));
+  }
+
+  return result;
+}
+
+vector<InputQuery> ReadDescriptions(const vector<Json::Node>& nodes,
+                                    ThreadPool& pool) {
+  vector<InputQuery> result(nodes.size());
+  ParallelFor(pool, nodes.size(), [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      result[i] = ReadDescription(nodes[i]);
+    }
+  });
+  return result;
+}
+
+vector<InputQuery> ReadDescriptions(vector<Json::Node>&& nodes,
+                                    ThreadPool& pool) {
+  vector<InputQuery> result(nodes.size());
+  ParallelFor(pool, nodes.size(), [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      result[i] = ReadDescription(move(nodes[i]));
+    }
+  });
+  return result;
+}
+
+vector<InputQuery> ReadDescriptions(istream& input) {
+  DescriptionsHandler handler;
+  Json::Parse(input, handler);
+  return handler.GetResult();
+}
+
 }  // namespace Descriptions
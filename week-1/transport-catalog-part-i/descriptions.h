@@ -2,25 +2,32 @@
 
 #include <string>
 #include <unordered_map>
+#include <utility>
 #include <variant>
 #include <vector>
 
 #include "json.h"
+#include "json_view.h"
 #include "sphere.h"
+#include "thread_pool.h"
 
 namespace Descriptions {
 struct Stop {
   std::string name;
   Sphere::Point position;
-  std::unordered_map<std::string, int> distances;
+  // as given in the input, see DistanceTable for lookups
+  std::vector<std::pair<std::string, int>> distances;
 
   static Stop ParseFrom(const Json::Dict& attrs);
+  // Moves the strings out of the nodes instead of copying them
+  static Stop ParseFrom(Json::Dict&& attrs);
+  static Stop ParseFrom(const JsonView::Object& attrs);
 };
 
-int ComputeStopsDistance(const Stop& lhs, const Stop& rhs);
-
 std::vector<std::string> ParseStops(const std::vector<Json::Node>& stop_nodes,
                                     bool is_roundtrip);
+std::vector<std::string> ParseStops(std::vector<Json::Node>&& stop_nodes,
+                                    bool is_roundtrip);
 
 struct Bus {
   std::string name;
@@ -28,11 +35,27 @@ struct Bus {
   bool is_roundtrip;
 
   static Bus ParseFrom(const Json::Dict& attrs);
+  static Bus ParseFrom(Json::Dict&& attrs);
+  static Bus ParseFrom(const JsonView::Object& attrs);
 };
 
 using InputQuery = std::variant<Stop, Bus>;
 
 std::vector<InputQuery> ReadDescriptions(const std::vector<Json::Node>& nodes);
+// Consumes the nodes: names are moved out of them
+std::vector<InputQuery> ReadDescriptions(std::vector<Json::Node>&& nodes);
+
+// Same result, with nodes parsed in chunks by the pool workers
+std::vector<InputQuery> ReadDescriptions(const std::vector<Json::Node>& nodes,
+                                         ThreadPool& pool);
+std::vector<InputQuery> ReadDescriptions(std::vector<Json::Node>&& nodes,
+                                         ThreadPool& pool);
+
+std::vector<InputQuery> ReadDescriptions(const JsonView::Array& nodes);
+
+// Reads the base_requests array straight from the input,
+// without building Json nodes for it
+std::vector<InputQuery> ReadDescriptions(std::istream& input);
 
 template <typename Object>
 using Dict = std::unordered_map<std::string, const Object*>;
@@ -0,0 +1,81 @@
+#include "distance_table.h"
+
+#include <stdexcept>
+
+using namespace std;
+
+DistanceTable::DistanceTable(const Descriptions::StopsDict& stops_dict) {
+  size_t distance_count = 0;
+  stop_ids_.reserve(stops_dict.size());
+  for (const auto& [stop_name, stop] : stops_dict) {
+    stop_ids_.emplace(stop_name, stop_ids_.size());
+    distance_count += stop->distances.size();
+  }
+
+  // every explicit distance may add its reverse: keep load factor below 1/2
+  size_t slot_count = 2;
+  hash_shift_ = 63;
+  while (slot_count < distance_count * 4) {
+    slot_count *= 2;
+    --hash_shift_;
+  }
+  slots_.resize(slot_count);
+
+  for (const auto& [stop_name, stop] : stops_dict) {
+    const StopId from = stop_ids_.at(stop_name);
+    for (const auto& [neighbour_name, distance] : stop->distances) {
+      // unknown stops are on no bus, so their distances are never asked for
+      const auto neighbour_it = stop_ids_.find(neighbour_name);
+      if (neighbour_it == stop_ids_.end()) {
+        continue;
+      }
+      const uint64_t key = MakeKey(from, neighbour_it->second);
+      slots_[FindSlot(key)] = {key, distance};
+    }
+  }
+  for (const auto& [stop_name, stop] : stops_dict) {
+    const StopId to = stop_ids_.at(stop_name);
+    for (const auto& [neighbour_name, distance] : stop->distances) {
+      const auto neighbour_it = stop_ids_.find(neighbour_name);
+      if (neighbour_it == stop_ids_.end()) {
+        continue;
+      }
+      const uint64_t reverse_key = MakeKey(neighbour_it->second, to);
+      if (Slot& slot = slots_[FindSlot(reverse_key)]; slot.key == kEmptyKey) {
+        slot = {reverse_key, distance};
+      }
+    }
+  }
+}
+
+DistanceTable::StopId DistanceTable::GetStopId(const string& stop_name) const {
+  return stop_ids_.at(stop_name);
+}
+
+vector<DistanceTable::StopId> DistanceTable::GetStopIds(
+    const vector<string>& stops) const {
+  vector<StopId> ids;
+  ids.reserve(stops.size());
+  for (const string& stop_name : stops) {
+    ids.push_back(GetStopId(stop_name));
+  }
+  return ids;
+}
+
+int DistanceTable::Get(StopId from, StopId to) const {
+  const Slot& slot = slots_[FindSlot(MakeKey(from, to))];
+  if (slot.key == kEmptyKey) {
+    throw out_of_range("no road distance between stops");
+  }
+  return slot.distance;
+}
+
+size_t DistanceTable::FindSlot(uint64_t key) const {
+  const size_t mask = slots_.size() - 1;
+  // Fibonacci hashing: the high bits of the product are well mixed
+  size_t idx = (key * 0x9E3779B97F4A7C15ull) >> hash_shift_;
+  while (slots_[idx].key != key && slots_[idx].key != kEmptyKey) {
+    idx = (idx + 1) & mask;
+  }
+  return idx;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "descriptions.h"
+
+// Road distances of the whole catalog, keyed by dense stop ids.
+// (from, to) pairs are packed into 64-bit keys of an open addressing table;
+// a direction missing in the input is filled from the opposite one
+// while building, so every lookup is a single probe sequence.
+class DistanceTable {
+ public:
+  using StopId = uint32_t;
+
+  explicit DistanceTable(const Descriptions::StopsDict& stops_dict);
+
+  StopId GetStopId(const std::string& stop_name) const;
+  std::vector<StopId> GetStopIds(const std::vector<std::string>& stops) const;
+
+  int Get(StopId from, StopId to) const;
+
+ private:
+  static constexpr uint64_t kEmptyKey = UINT64_MAX;
+
+  struct Slot {
+    uint64_t key = kEmptyKey;
+    int distance = 0;
+  };
+
+  static uint64_t MakeKey(StopId from, StopId to) {
+    return static_cast<uint64_t>(from) << 32 | to;
+  }
+
+  size_t FindSlot(uint64_t key) const;
+
+  std::unordered_map<std::string, StopId> stop_ids_;
+  std::vector<Slot> slots_;  // size is a power of two
+  int hash_shift_ = 63;
+};
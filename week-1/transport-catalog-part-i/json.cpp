@@ -1,11 +1,94 @@
 #include "json.h"
 
+#include <charconv>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_set>
+
+#include "json_cbor.h"
 #include "utils.h"
 
 using namespace std;
 
 namespace Json {
 
+namespace {
+
+uint32_t HashKey(string_view key) {
+  uint32_t hash = 2166136261;  // FNV-1a
+  for (const char c : key) {
+    hash = (hash ^ static_cast<unsigned char>(c)) * 16777619;
+  }
+  return hash;
+}
+
+// Interned keys already used by a thread: open addressing
+// with linear probing, at most half full
+class ThreadKeys {
+ public:
+  const string* Find(string_view key, uint32_t hash) const {
+    for (size_t i = hash & (slots_.size() - 1); slots_[i].key;
+         i = (i + 1) & (slots_.size() - 1)) {
+      if (slots_[i].hash == hash && *slots_[i].key == key) {
+        return slots_[i].key;
+      }
+    }
+    return nullptr;
+  }
+
+  void Add(const string* key, uint32_t hash) {
+    if (2 * (count_ + 1) > slots_.size()) {
+      vector<Slot> old_slots(slots_.size() * 2);
+      swap(old_slots, slots_);
+      for (const Slot& slot : old_slots) {
+        if (slot.key) {
+          Insert(slot);
+        }
+      }
+    }
+    Insert({hash, key});
+    ++count_;
+  }
+
+ private:
+  struct Slot {
+    uint32_t hash;
+    const string* key;
+  };
+
+  void Insert(Slot slot) {
+    size_t i = slot.hash & (slots_.size() - 1);
+    while (slots_[i].key) {
+      i = (i + 1) & (slots_.size() - 1);
+    }
+    slots_[i] = slot;
+  }
+
+  vector<Slot> slots_ = vector<Slot>(256);
+  size_t count_ = 0;
+};
+
+}  // namespace
+
+Key::Key(string_view key) {
+  // the shared table is locked on the first use of a key by a thread only
+  const uint32_t hash = HashKey(key);
+  thread_local ThreadKeys thread_keys;
+  if ((key_ = thread_keys.Find(key, hash))) {
+    return;
+  }
+  static mutex table_mutex;
+  // nodes of the set keep their addresses
+  static unordered_set<string> table;
+  {
+    lock_guard lock(table_mutex);
+    key_ = &*table.emplace(key).first;
+  }
+  thread_keys.Add(key_, hash);
+}
+
 Node LoadArray(istream& input) {
   vector<Node> result;
 
@@ -28,37 +111,38 @@ Node LoadBool(istream& input) {
 }
 
 Node LoadNumber(istream& input) {
-  bool is_negative = false;
-  if (input.peek() == '-') {
-    is_negative = true;
-    input.get();
-  }
-  int int_part = 0;
-  while (isdigit(input.peek())) {
-    int_part *= 10;
-    int_part += input.get() - '0';
-  }
-  if (input.peek() != '.') {
-    return Node(int_part * (is_negative ? -1 : 1));
-  }
-  input.get();  // '.'
-  double result = int_part;
-  double frac_mult = 0.1;
-  while (isdigit(input.peek())) {
-    result += frac_mult * (input.get() - '0');
-    frac_mult /= 10;
-  }
-  return Node(result * (is_negative ? -1 : 1));
+  return visit([](auto value) { return Node(value); },
+               ReadNumber([&input] { return input.peek(); },
+                          [&input] { return input.get(); }));
 }
 
-Node LoadString(istream& input) {
+// After the opening quote: reads up to the closing one and unescapes,
+// as the other readers do
+string ReadStringBody(istream& input) {
   string line;
   getline(input, line, '"');
-  return Node(move(line));
+  const auto is_quote_escaped = [&line] {
+    const size_t last_idx = line.find_last_not_of('\\');
+    const size_t slash_count =
+        line.size() - (last_idx == string::npos ? 0 : last_idx + 1);
+    return slash_count % 2 == 1;
+  };
+  for (string rest; input && is_quote_escaped();) {
+    getline(input, rest, '"');
+    line += '"';
+    line += rest;
+  }
+  if (line.find('\\') != string::npos) {
+    line.erase(Unescape(line.data(), line.data() + line.size(), line.data()) -
+               line.data());
+  }
+  return line;
 }
 
+Node LoadString(istream& input) { return Node(ReadStringBody(input)); }
+
 Node LoadDict(istream& input) {
-  Dict result;
+  vector<Dict::value_type> result;
 
   for (char c; input >> c && c != '}';) {
     if (c == ',') {
@@ -67,10 +151,10 @@ Node LoadDict(istream& input) {
 
     string key = LoadString(input).AsString();
     input >> c;
-    result.emplace(move(key), LoadNode(input));
+    result.emplace_back(move(key), LoadNode(input));
   }
 
-  return Node(move(result));
+  return Node(Dict(move(result)));
 }
 
 Node LoadNode(istream& input) {
@@ -94,30 +178,224 @@ Node LoadNode(istream& input) {
 
 Document Load(istream& input) { return Document{LoadNode(input)}; }
 
-template <>
-void PrintValue<string>(const string& value, ostream& output) {
+string ReadString(istream& input) {
+  char c;
+  input >> c;  // '"'
+  return ReadStringBody(input);
+}
+
+int NarrowInt(int64_t value) {
+  if (value < numeric_limits<int>::min() ||
+      value > numeric_limits<int>::max()) {
+    throw out_of_range("JSON integer does not fit int");
+  }
+  return value;
+}
+
+int Node::AsInt() const { return NarrowInt(AsInt64()); }
+
+variant<int64_t, double> ParseNumber(const char*& begin, const char* end) {
+  const char* current = begin;
+  const auto skip_digits = [&current, end] {
+    while (current < end && isdigit(static_cast<unsigned char>(*current))) {
+      ++current;
+    }
+  };
+  if (current < end && *current == '-') {
+    ++current;
+  }
+  skip_digits();
+  bool is_integer = true;
+  if (current < end && *current == '.') {
+    is_integer = false;
+    ++current;
+    skip_digits();
+  }
+  if (current < end && (*current == 'e' || *current == 'E')) {
+    is_integer = false;
+    ++current;
+    if (current < end && (*current == '+' || *current == '-')) {
+      ++current;
+    }
+    skip_digits();
+  }
+
+  if (is_integer) {
+    int64_t value;
+    if (from_chars(begin, current, value).ec == errc{}) {
+      begin = current;
+      return value;
+    }
+  }
+  double value;
+  if (from_chars(begin, current, value).ec != errc{}) {
+    throw invalid_argument("invalid number in JSON input");
+  }
+  begin = current;
+  return value;
+}
+
+namespace {
+
+void AppendUtf8(uint32_t code_point, char*& output) {
+  if (code_point < 0x80) {
+    *output++ = code_point;
+  } else if (code_point < 0x800) {
+    *output++ = 0xC0 | (code_point >> 6);
+    *output++ = 0x80 | (code_point & 0x3F);
+  } else if (code_point < 0x10000) {
+    *output++ = 0xE0 | (code_point >> 12);
+    *output++ = 0x80 | ((code_point >> 6) & 0x3F);
+    *output++ = 0x80 | (code_point & 0x3F);
+  } else {
+    *output++ = 0xF0 | (code_point >> 18);
+    *output++ = 0x80 | ((code_point >> 12) & 0x3F);
+    *output++ = 0x80 | ((code_point >> 6) & 0x3F);
+    *output++ = 0x80 | (code_point & 0x3F);
+  }
+}
+
+uint32_t ParseHex4(const char* input, const char* end) {
+  if (end - input < 4) {
+    throw invalid_argument("bad \\u escape in JSON input");
+  }
+  uint32_t result = 0;
+  for (int i = 0; i < 4; ++i) {
+    const char c = input[i];
+    result <<= 4;
+    if (isdigit(static_cast<unsigned char>(c))) {
+      result |= c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      result |= c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+      result |= c - 'A' + 10;
+    } else {
+      throw invalid_argument("bad \\u escape in JSON input");
+    }
+  }
+  return result;
+}
+
+}  // namespace
+
+char* Unescape(const char* begin, const char* end, char* output) {
+  for (const char* input = begin; input < end;) {
+    if (*input != '\\') {
+      *output++ = *input++;
+      continue;
+    }
+    const char c = input[1];
+    input += 2;
+    switch (c) {
+      case 'b':
+        *output++ = '\b';
+        break;
+      case 'f':
+        *output++ = '\f';
+        break;
+      case 'n':
+        *output++ = '\n';
+        break;
+      case 'r':
+        *output++ = '\r';
+        break;
+      case 't':
+        *output++ = '\t';
+        break;
+      case 'u': {
+        uint32_t code_point = ParseHex4(input, end);
+        input += 4;
+        if (code_point >= 0xD800 && code_point < 0xDC00 &&
+            end - input >= 6 && input[0] == '\\' && input[1] == 'u') {
+          const uint32_t low = ParseHex4(input + 2, end);
+          if (low >= 0xDC00 && low < 0xE000) {
+            code_point =
+                0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+            input += 6;
+          }
+        }
+        AppendUtf8(code_point, output);
+        break;
+      }
+      default:  // '"', '\\', '/'
+        *output++ = c;
+    }
+  }
+  return output;
+}
+
+int ReadInt(istream& input) { return LoadNode(input).AsInt(); }
+
+double ReadDouble(istream& input) { return LoadNode(input).AsDouble(); }
+
+bool ReadBool(istream& input) { return LoadNode(input).AsBool(); }
+
+void SkipValue(istream& input) { LoadNode(input); }
+
+namespace {
+
+// Quotes, backslashes and control characters are escaped,
+// so that strings unescaped by the readers are printed back as JSON
+void PrintString(string_view value, OutputBuffer& output) {
+  static const char kHexDigits[] = "0123456789abcdef";
   output << '"';
-  int start_idx = 0;
-  for (int i = 0; i < value.size(); ++i) {
-    if (value[i] == '"') {
-      output << std::string_view(value.c_str() + start_idx, i - start_idx);
-      output << "\\\"";
-      start_idx = i + 1;
+  size_t start_idx = 0;
+  for (size_t i = 0; i < value.size(); ++i) {
+    const unsigned char c = value[i];
+    if (c != '"' && c != '\\' && c >= 0x20) {
+      continue;
+    }
+    output << value.substr(start_idx, i - start_idx);
+    switch (c) {
+      case '"':
+        output << "\\\"";
+        break;
+      case '\\':
+        output << "\\\\";
+        break;
+      case '\n':
+        output << "\\n";
+        break;
+      case '\r':
+        output << "\\r";
+        break;
+      case '\t':
+        output << "\\t";
+        break;
+      default:
+        output << "\\u00" << kHexDigits[c >> 4] << kHexDigits[c & 0xF];
     }
+    start_idx = i + 1;
   }
-  output << std::string_view(value.c_str() + start_idx,
-                             value.size() - start_idx);
+  output << value.substr(start_idx);
   output << '"';
 }
 
+}  // namespace
+
+template <>
+void PrintValue<string>(const string& value, OutputBuffer& output) {
+  PrintString(value, output);
+}
+
+template <>
+void PrintValue<bool>(const bool& value, OutputBuffer& output) {
+  output << (value ? "true" : "false");
+}
+
+template <>
+void PrintValue<int64_t>(const int64_t& value, OutputBuffer& output) {
+  output << value;
+}
+
 template <>
-void PrintValue<bool>(const bool& value, std::ostream& output) {
-  output << std::boolalpha << value;
+void PrintValue<double>(const double& value, OutputBuffer& output) {
+  output << value;
 }
 
 template <>
 void PrintValue<std::vector<Node>>(const std::vector<Node>& nodes,
-                                   std::ostream& output) {
+                                   OutputBuffer& output) {
   output << '[';
   bool first = true;
   for (const Node& node : nodes) {
@@ -131,7 +409,7 @@ void PrintValue<std::vector<Node>>(const std::vector<Node>& nodes,
 }
 
 template <>
-void PrintValue<Dict>(const Dict& dict, std::ostream& output) {
+void PrintValue<Dict>(const Dict& dict, OutputBuffer& output) {
   output << '{';
   bool first = true;
   for (const auto& [key, node] : dict) {
@@ -139,20 +417,156 @@ void PrintValue<Dict>(const Dict& dict, std::ostream& output) {
       output << ", ";
     }
     first = false;
-    PrintValue(key, output);
+    PrintString(key, output);
     output << ": ";
     PrintNode(node, output);
   }
   output << '}';
 }
 
-void PrintNode(const Json::Node& node, ostream& output) {
+void PrintNode(const Json::Node& node, OutputBuffer& output) {
   visit([&output](const auto& value) { PrintValue(value, output); },
         node.GetBase());
 }
 
-void Print(const Document& document, ostream& output) {
+void Print(const Document& document, OutputBuffer& output) {
   PrintNode(document.GetRoot(), output);
 }
 
+void PrintNode(const Node& node, ostream& output) {
+  OutputBuffer buffer(output);
+  PrintNode(node, buffer);
+}
+
+void Print(const Document& document, ostream& output) {
+  OutputBuffer buffer(output);
+  Print(document, buffer);
+}
+
+Writer& Writer::BeginObject() {
+  BeginValue();
+  output_ << (format_ == Format::CBOR ? CborPrivate::kIndefiniteMap : '{');
+  is_first_item_ = true;
+  return *this;
+}
+
+Writer& Writer::EndObject() {
+  output_ << (format_ == Format::CBOR ? CborPrivate::kBreak : '}');
+  is_first_item_ = false;
+  return *this;
+}
+
+Writer& Writer::BeginArray() {
+  BeginValue();
+  output_ << (format_ == Format::CBOR ? CborPrivate::kIndefiniteArray : '[');
+  is_first_item_ = true;
+  return *this;
+}
+
+Writer& Writer::EndArray() {
+  output_ << (format_ == Format::CBOR ? CborPrivate::kBreak : ']');
+  is_first_item_ = false;
+  return *this;
+}
+
+Writer& Writer::Key(string_view key) {
+  if (format_ == Format::CBOR) {
+    CborPrivate::PrintString(key, output_);
+    return *this;
+  }
+  if (!is_first_item_) {
+    output_ << ", ";
+  }
+  is_first_item_ = false;
+  PrintString(key, output_);
+  output_ << ": ";
+  is_after_key_ = true;
+  return *this;
+}
+
+Writer& Writer::Value(string_view value) {
+  BeginValue();
+  if (format_ == Format::CBOR) {
+    CborPrivate::PrintString(value, output_);
+  } else {
+    PrintString(value, output_);
+  }
+  return *this;
+}
+
+Writer& Writer::Value(int64_t value) {
+  BeginValue();
+  if (format_ == Format::CBOR) {
+    CborPrivate::PrintInt(value, output_);
+  } else {
+    PrintValue(value, output_);
+  }
+  return *this;
+}
+
+Writer& Writer::Value(double value) {
+  BeginValue();
+  if (format_ == Format::CBOR) {
+    CborPrivate::PrintDouble(value, output_);
+  } else {
+    PrintValue(value, output_);
+  }
+  return *this;
+}
+
+Writer& Writer::Value(bool value) {
+  BeginValue();
+  if (format_ == Format::CBOR) {
+    CborPrivate::PrintBool(value, output_);
+  } else {
+    PrintValue(value, output_);
+  }
+  return *this;
+}
+
+OutputBuffer& Writer::RawValue() {
+  BeginValue();
+  return output_;
+}
+
+Writer& Writer::Gap() {
+  BeginValue();
+  gap_offset_ = output_.GetSize();
+  return *this;
+}
+
+void Writer::BeginValue() {
+  // CBOR items need no separators
+  if (format_ == Format::CBOR) {
+    return;
+  }
+  if (is_after_key_) {
+    is_after_key_ = false;
+  } else if (!is_first_item_) {
+    output_ << ", ";
+  }
+  is_first_item_ = false;
+}
+
+Template::Template(const function<void(Writer&)>& write, Format format)
+    : format_(format) {
+  OutputBuffer output;
+  Writer writer(output, format);
+  write(writer);
+  const string result = output.Take();
+  const size_t gap_offset = writer.GetGapOffset().value();
+  head_ = result.substr(0, gap_offset);
+  tail_ = result.substr(gap_offset);
+}
+
+void Template::Print(const Node& gap_value, OutputBuffer& output) const {
+  output << head_;
+  if (format_ == Format::CBOR) {
+    PrintCbor(gap_value, output);
+  } else {
+    PrintNode(gap_value, output);
+  }
+  output << tail_;
+}
+
 }  // namespace Json
@@ -1,20 +1,98 @@
 #pragma once
 
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
 #include <iostream>
-#include <map>
+#include <stdexcept>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <variant>
 #include <vector>
 
+#include "output_buffer.h"
+
 namespace Json {
 
 class Node;
-using Dict = std::map<std::string, Node>;
 using Array = std::vector<Node>;
 
+// Object key interned in a table shared by every thread: objects with
+// the same keys share a single copy of them, and equal keys are equal
+// handles, so they are compared by address.
+// Interned keys are never freed: the keys of an input file come from
+// a fixed set, while untrusted input of long-lived processes is read
+// without nodes for keys of its own, see Requests::ParseRequest
+class Key {
+ public:
+  explicit Key(std::string_view key);
+
+  const std::string& str() const { return *key_; }
+  operator std::string_view() const { return *key_; }
+
+  friend bool operator==(Key lhs, Key rhs) { return lhs.key_ == rhs.key_; }
+  friend bool operator!=(Key lhs, Key rhs) { return lhs.key_ != rhs.key_; }
+  friend bool operator<(Key lhs, Key rhs) { return *lhs.key_ < *rhs.key_; }
+
+  friend bool operator==(Key lhs, std::string_view rhs) {
+    return *lhs.key_ == rhs;
+  }
+  friend bool operator!=(Key lhs, std::string_view rhs) {
+    return *lhs.key_ != rhs;
+  }
+  friend bool operator<(Key lhs, std::string_view rhs) {
+    return *lhs.key_ < rhs;
+  }
+
+ private:
+  const std::string* key_;
+};
+
+// Object fields kept in a single vector sorted by key.
+// Objects are small, so a binary search over contiguous memory
+// beats a tree with an allocation per field.
+// The interface follows the used part of std::map
+class Dict {
+ public:
+  using value_type = std::pair<Key, Node>;
+  using iterator = std::vector<value_type>::iterator;
+  using const_iterator = std::vector<value_type>::const_iterator;
+
+  Dict() = default;
+  Dict(std::initializer_list<std::pair<std::string_view, Node>> items);
+  // Of equal keys the first one is kept, as with map::emplace
+  explicit Dict(std::vector<value_type> items);
+
+  iterator begin() { return items_.begin(); }
+  iterator end() { return items_.end(); }
+  const_iterator begin() const { return items_.begin(); }
+  const_iterator end() const { return items_.end(); }
+
+  size_t size() const { return items_.size(); }
+  bool empty() const { return items_.empty(); }
+
+  iterator find(std::string_view key);
+  const_iterator find(std::string_view key) const;
+  size_t count(std::string_view key) const;
+  const Node& at(std::string_view key) const;
+  Node& at(std::string_view key);
+  Node& operator[](std::string_view key);
+
+  std::pair<iterator, bool> emplace(std::string_view key, Node value);
+
+ private:
+  iterator LowerBound(std::string_view key);
+
+  std::vector<value_type> items_;
+};
+
 class Node
-    : std::variant<std::vector<Node>, Dict, bool, int, double, std::string> {
+    : std::variant<std::vector<Node>, Dict, bool, int64_t, double,
+                   std::string> {
  public:
   using variant::variant;
   const variant& GetBase() const { return *this; }
@@ -22,19 +100,95 @@ class Node
   const auto& AsArray() const { return std::get<std::vector<Node>>(*this); }
   const auto& AsMap() const { return std::get<Dict>(*this); }
   bool AsBool() const { return std::get<bool>(*this); }
-  int AsInt() const { return std::get<int>(*this); }
+  // Throws std::out_of_range for integers beyond int
+  int AsInt() const;
+  int64_t AsInt64() const { return std::get<int64_t>(*this); }
   double AsDouble() const {
     return std::holds_alternative<double>(*this) ? std::get<double>(*this)
-                                                 : std::get<int>(*this);
+                                                 : std::get<int64_t>(*this);
   }
   const auto& AsString() const { return std::get<std::string>(*this); }
+
+  // Move the value out, for readers done with the node
+  std::vector<Node> TakeArray() && {
+    return std::get<std::vector<Node>>(std::move(*this));
+  }
+  Dict TakeMap() && { return std::get<Dict>(std::move(*this)); }
+  std::string TakeString() && {
+    return std::get<std::string>(std::move(*this));
+  }
 };
 
+inline Dict::Dict(
+    std::initializer_list<std::pair<std::string_view, Node>> items)
+    : Dict(std::vector<value_type>(items.begin(), items.end())) {}
+
+inline Dict::Dict(std::vector<value_type> items) : items_(std::move(items)) {
+  const auto key_less = [](const value_type& lhs, const value_type& rhs) {
+    return lhs.first < rhs.first;
+  };
+  if (!std::is_sorted(items_.begin(), items_.end(), key_less)) {
+    std::stable_sort(items_.begin(), items_.end(), key_less);
+  }
+  items_.erase(std::unique(items_.begin(), items_.end(),
+                           [](const value_type& lhs, const value_type& rhs) {
+                             return lhs.first == rhs.first;
+                           }),
+               items_.end());
+}
+
+inline Dict::iterator Dict::LowerBound(std::string_view key) {
+  return std::lower_bound(
+      items_.begin(), items_.end(), key,
+      [](const value_type& item, std::string_view key) {
+        return item.first < key;
+      });
+}
+
+inline Dict::iterator Dict::find(std::string_view key) {
+  const auto it = LowerBound(key);
+  return it != items_.end() && it->first == key ? it : items_.end();
+}
+
+inline Dict::const_iterator Dict::find(std::string_view key) const {
+  return const_cast<Dict&>(*this).find(key);
+}
+
+inline size_t Dict::count(std::string_view key) const {
+  return find(key) != end();
+}
+
+inline Node& Dict::at(std::string_view key) {
+  const auto it = find(key);
+  if (it == items_.end()) {
+    throw std::out_of_range("Json::Dict::at");
+  }
+  return it->second;
+}
+
+inline const Node& Dict::at(std::string_view key) const {
+  return const_cast<Dict&>(*this).at(key);
+}
+
+inline Node& Dict::operator[](std::string_view key) {
+  return emplace(key, Node()).first->second;
+}
+
+inline std::pair<Dict::iterator, bool> Dict::emplace(std::string_view key,
+                                                     Node value) {
+  const auto it = LowerBound(key);
+  if (it != items_.end() && it->first == key) {
+    return {it, false};
+  }
+  return {items_.emplace(it, Key(key), std::move(value)), true};
+}
+
 class Document {
  public:
   explicit Document(Node root) : root(move(root)) {}
 
   const Node& GetRoot() const { return root; }
+  Node TakeRoot() && { return std::move(root); }
 
  private:
   Node root;
@@ -44,26 +198,195 @@ Node LoadNode(std::istream& input);
 
 Document Load(std::istream& input);
 
-void PrintNode(const Node& node, std::ostream& output);
+// Streaming reading for inputs too large to keep as a whole tree.
+// Each callback must consume exactly one value from the input:
+// with LoadNode, the Read* helpers or nested ForEach* calls
+template <typename Callback>
+void ForEachElement(std::istream& input, Callback callback);
+
+template <typename Callback>
+void ForEachField(std::istream& input, Callback callback);
+
+// Parses the number at the start of [begin, end) and moves begin past it.
+// Numbers without a fraction and an exponent stay integers
+// unless they do not fit int64_t
+std::variant<int64_t, double> ParseNumber(const char*& begin,
+                                          const char* end);
+
+inline bool IsNumberChar(int c) {
+  return isdigit(c) || c == '-' || c == '+' || c == '.' || c == 'e' ||
+         c == 'E';
+}
+
+// Reads every number character with peek and get, so that no tail
+// of a long number is left, and parses them with ParseNumber:
+// extra digits are rounded away. Throws std::invalid_argument
+// unless the characters make a single number
+template <typename Peek, typename Get>
+std::variant<int64_t, double> ReadNumber(Peek peek, Get get) {
+  char buffer[64];
+  size_t size = 0;
+  std::string long_number;  // for numbers beyond the buffer only
+  for (int c = peek(); IsNumberChar(c); c = peek()) {
+    if (size == sizeof(buffer)) {
+      long_number.append(buffer, size);
+      size = 0;
+    }
+    buffer[size++] = get();
+  }
+  const char* begin = buffer;
+  const char* end = buffer + size;
+  if (!long_number.empty()) {
+    long_number.append(buffer, size);
+    begin = long_number.data();
+    end = begin + long_number.size();
+  }
+  const auto result = ParseNumber(begin, end);
+  if (begin != end) {
+    throw std::invalid_argument("invalid number in JSON input");
+  }
+  return result;
+}
+
+// Throws std::out_of_range for values beyond int
+int NarrowInt(int64_t value);
+
+// Writes the unescaped body of a string to output, which may be begin:
+// the result is never longer. Returns the end of the output
+char* Unescape(const char* begin, const char* end, char* output);
+
+std::string ReadString(std::istream& input);
+int ReadInt(std::istream& input);
+double ReadDouble(std::istream& input);
+bool ReadBool(std::istream& input);
+void SkipValue(std::istream& input);
+
+void PrintNode(const Node& node, OutputBuffer& output);
 
 template <typename Value>
-void PrintValue(const Value& value, std::ostream& output) {
+void PrintValue(const Value& value, OutputBuffer& output) {
   output << value;
 }
 
 template <>
-void PrintValue<std::string>(const std::string& value, std::ostream& output);
+void PrintValue<std::string>(const std::string& value, OutputBuffer& output);
 
 template <>
-void PrintValue<bool>(const bool& value, std::ostream& output);
+void PrintValue<bool>(const bool& value, OutputBuffer& output);
+
+template <>
+void PrintValue<int64_t>(const int64_t& value, OutputBuffer& output);
+
+// With the precision of the output, as operator<< does
+template <>
+void PrintValue<double>(const double& value, OutputBuffer& output);
 
 template <>
 void PrintValue<std::vector<Node>>(const std::vector<Node>& nodes,
-                                   std::ostream& output);
+                                   OutputBuffer& output);
 
 template <>
-void PrintValue<Dict>(const Dict& dict, std::ostream& output);
+void PrintValue<Dict>(const Dict& dict, OutputBuffer& output);
+
+void Print(const Document& document, OutputBuffer& output);
+
+// Printers of streams go through a buffer flushed on return
+void PrintNode(const Node& node, std::ostream& output);
+
+template <typename Value>
+void PrintValue(const Value& value, std::ostream& output) {
+  OutputBuffer buffer(output);
+  PrintValue(value, buffer);
+}
 
 void Print(const Document& document, std::ostream& output);
 
+template <typename Callback>
+void ForEachElement(std::istream& input, Callback callback) {
+  char c;
+  input >> c;  // '['
+  while (input >> c && c != ']') {
+    if (c != ',') {
+      input.putback(c);
+    }
+    callback(input);
+  }
+}
+
+template <typename Callback>
+void ForEachField(std::istream& input, Callback callback) {
+  char c;
+  input >> c;  // '{'
+  while (input >> c && c != '}') {
+    if (c == ',') {
+      input >> c;
+    }
+    input.putback(c);
+    const std::string key = ReadString(input);
+    input >> c;  // ':'
+    callback(key, input);
+  }
+}
+
+enum class Format { JSON, CBOR };
+
+// Prints values straight to the output, in the same format as PrintValue
+// or PrintCbor of json_cbor.h, without building nodes for them.
+// Keys are printed in the order they are given,
+// CBOR containers with indefinite lengths
+class Writer {
+ public:
+  explicit Writer(OutputBuffer& output, Format format = Format::JSON)
+      : output_(output), format_(format) {}
+
+  Format GetFormat() const { return format_; }
+
+  Writer& BeginObject();
+  Writer& EndObject();
+  Writer& BeginArray();
+  Writer& EndArray();
+  Writer& Key(std::string_view key);
+
+  Writer& Value(std::string_view value);
+  Writer& Value(const char* value) { return Value(std::string_view(value)); }
+  Writer& Value(int value) { return Value(static_cast<int64_t>(value)); }
+  Writer& Value(int64_t value);
+  Writer& Value(double value);
+  Writer& Value(bool value);
+
+  // Buffer for a single value printed by the caller
+  OutputBuffer& RawValue();
+
+  // Leaves a place for a value, see Template
+  Writer& Gap();
+  std::optional<size_t> GetGapOffset() const { return gap_offset_; }
+
+ private:
+  void BeginValue();
+
+  OutputBuffer& output_;
+  Format format_;
+  bool is_first_item_ = true;
+  bool is_after_key_ = false;
+  std::optional<size_t> gap_offset_;
+};
+
+// Output printed in advance with a gap for one value.
+// Printing fills the gap and copies the rest as is
+class Template {
+ public:
+  // write must call Writer::Gap exactly once
+  explicit Template(const std::function<void(Writer&)>& write,
+                    Format format = Format::JSON);
+
+  Format GetFormat() const { return format_; }
+
+  void Print(const Node& gap_value, OutputBuffer& output) const;
+
+ private:
+  Format format_;
+  std::string head_;
+  std::string tail_;
+};
+
 }  // namespace Json
@@ -0,0 +1,432 @@
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+#include "json.h"
+#include "json_cbor.h"
+#include "json_sax.h"
+#include "json_view.h"
+#include "output_buffer.h"
+#include "profile.h"
+#include "structural_index.h"
+#include "thread_pool.h"
+
+using namespace std;
+
+namespace {
+
+const int kRunCount = 5;
+
+// Counts scalars, so that their values are not left unused
+struct CountingHandler : Json::Handler {
+  size_t count = 0;
+
+  void OnString(string_view value) { count += !value.empty(); }
+  void OnNumber(Json::Number value) { count += value.index(); }
+  void OnBool(bool value) { count += value; }
+};
+
+size_t CountNodes(const JsonView::Node& node) {
+  size_t count = 1;
+  if (node.GetType() == JsonView::Node::Type::ARRAY) {
+    for (const auto& item : node.AsArray()) {
+      count += CountNodes(item);
+    }
+  } else if (node.GetType() == JsonView::Node::Type::OBJECT) {
+    for (const auto& member : node.AsMap()) {
+      count += CountNodes(member.value);
+    }
+  }
+  return count;
+}
+
+// Best of kRunCount runs, in seconds
+template <typename Func>
+double Measure(Func func) {
+  double best = numeric_limits<double>::max();
+  for (int run = 0; run < kRunCount; ++run) {
+    const auto start = chrono::steady_clock::now();
+    func();
+    best = min(best, chrono::duration<double>(chrono::steady_clock::now() -
+                                              start)
+                         .count());
+  }
+  return best;
+}
+
+void PrintResult(const string& name, double seconds, size_t size) {
+  cout << "  " << left << setw(24) << name << right << fixed
+       << setprecision(2) << setw(10) << seconds * 1000 << " ms"
+       << setw(10) << size / seconds / (1 << 20) << " MiB/s" << endl;
+}
+
+// Route responses: mostly "time" fields with fractional values
+string MakeNumbersInput(int response_count) {
+  ostringstream output;
+  output << '[';
+  for (int response_idx = 0; response_idx < response_count; ++response_idx) {
+    output << (response_idx > 0 ? ", " : "") << R"({"items": [)";
+    double total_time = 0;
+    for (int item_idx = 0; item_idx < 20; ++item_idx) {
+      const double time = (response_idx * 31 + item_idx * 17) % 1000 / 7.0;
+      total_time += time;
+      output << (item_idx > 0 ? ", " : "") << R"({"bus": "14", "span_count": )"
+             << item_idx % 5 + 1 << R"(, "time": )" << setprecision(17)
+             << time << R"(, "type": "Bus"})";
+    }
+    output << R"(], "request_id": )" << response_idx << R"(, "total_time": )"
+           << total_time << '}';
+  }
+  output << ']';
+  return output.str();
+}
+
+void BenchmarkSax(const string& contents) {
+  PrintResult("Json::Parse buffer", Measure([&contents] {
+                CountingHandler handler;
+                Json::Parse(contents, handler);
+              }),
+              contents.size());
+  PrintResult("Json::Parse stream", Measure([&contents] {
+                istringstream input(contents);
+                CountingHandler handler;
+                Json::Parse(input, handler);
+              }),
+              contents.size());
+}
+
+// The same nodes in CBOR, sizes are of the CBOR encoding
+void BenchmarkCbor(const Json::Document& document) {
+  ostringstream encoded;
+  Json::PrintCbor(document.GetRoot(), encoded);
+  const string contents = encoded.str();
+  PrintResult("Json::LoadCbor", Measure([&contents] {
+                Json::LoadCbor(contents);
+              }),
+              contents.size());
+  PrintResult("Json::PrintCbor", Measure([&document] {
+                OutputBuffer output;
+                Json::PrintCbor(document.GetRoot(), output);
+              }),
+              contents.size());
+}
+
+void BenchmarkNumbers() {
+  const string contents = MakeNumbersInput(20000);
+  cout << "route responses, " << contents.size() << " bytes" << endl;
+
+  PrintResult("Json::Load", Measure([&contents] {
+                istringstream input(contents);
+                Json::Load(input);
+              }),
+              contents.size());
+  BenchmarkSax(contents);
+
+  istringstream input(contents);
+  const Json::Document document = Json::Load(input);
+  size_t output_size = 0;
+  const double seconds = Measure([&document, &output_size] {
+    OutputBuffer output;
+    Json::Print(document, output);
+    output_size = output.GetSize();
+  });
+  PrintResult("Json::Print", seconds, output_size);
+  BenchmarkCbor(document);
+}
+
+void Benchmark(const string& path) {
+  ifstream file(path, ios::binary);
+  if (!file) {
+    cerr << "cannot open " << path << endl;
+    return;
+  }
+  const string contents{istreambuf_iterator<char>(file),
+                        istreambuf_iterator<char>()};
+  cout << path << ", " << contents.size() << " bytes" << endl;
+
+  PrintResult("Json::Load", Measure([&contents] {
+                istringstream input(contents);
+                Json::Load(input);
+              }),
+              contents.size());
+  BenchmarkSax(contents);
+  {
+    istringstream input(contents);
+    BenchmarkCbor(Json::Load(input));
+  }
+
+  for (const auto implementation :
+       {JsonView::IndexImplementation::SCALAR,
+        JsonView::IndexImplementation::SSE2,
+        JsonView::IndexImplementation::AVX2}) {
+    if (!JsonView::IsSupported(implementation)) {
+      continue;
+    }
+    const string name = JsonView::GetName(implementation);
+    PrintResult("index " + name, Measure([&] {
+                  JsonView::BuildStructuralIndex(contents, implementation);
+                }),
+                contents.size());
+    // the copy is made before every run, as parsing unescapes in place
+    PrintResult("JsonView " + name, Measure([&] {
+                  JsonView::Document(
+                      JsonView::MappedInput::FromString(contents),
+                      implementation);
+                }),
+                contents.size());
+  }
+
+  ThreadPool pool;
+  PrintResult("LoadAsJson parallel", Measure([&contents, &pool] {
+                JsonView::LoadAsJson(
+                    JsonView::MappedInput::FromString(contents), pool);
+              }),
+              contents.size());
+
+  // the root object only, then every node
+  for (const bool is_walked : {false, true}) {
+    PrintResult(is_walked ? "JsonView lazy, all" : "JsonView lazy, root",
+                Measure([&contents, is_walked] {
+                  const JsonView::Document document(
+                      JsonView::MappedInput::FromString(contents),
+                      JsonView::GetDefaultIndexImplementation(),
+                      JsonView::ParseMode::LAZY);
+                  if (is_walked) {
+                    CountNodes(document.GetRoot());
+                  } else {
+                    document.GetRoot().AsMap();
+                  }
+                }),
+                contents.size());
+  }
+}
+
+// Synthetic catalogs in the input format: stops on a grid, each with road
+// distances to the kNeighbourCount stops that follow it, and a bus
+// for every kBusStride stops along kRouteLength of them
+const int kCorpusStopCounts[] = {1000, 10000, 100000};
+const int kNeighbourCount = 20;
+const int kBusStride = 20;
+const int kRouteLength = 200;
+
+string MakeStopName(int stop_idx) {
+  return "Остановка " + to_string(stop_idx);
+}
+
+string MakeCatalogInput(int stop_count) {
+  OutputBuffer output;
+  Json::Writer writer(output);
+  writer.BeginObject();
+
+  writer.Key("routing_settings").BeginObject();
+  writer.Key("bus_wait_time").Value(2).Key("bus_velocity").Value(30);
+  writer.EndObject();
+
+  writer.Key("render_settings").BeginObject();
+  writer.Key("width").Value(1200).Key("height").Value(1200);
+  writer.Key("padding").Value(50).Key("stop_radius").Value(5);
+  writer.Key("line_width").Value(14).Key("underlayer_width").Value(3);
+  writer.Key("bus_label_font_size").Value(20);
+  writer.Key("bus_label_offset").BeginArray().Value(7).Value(15).EndArray();
+  writer.Key("stop_label_font_size").Value(20);
+  writer.Key("stop_label_offset").BeginArray().Value(7).Value(-3).EndArray();
+  writer.Key("underlayer_color").BeginArray();
+  writer.Value(255).Value(255).Value(255).Value(0.85).EndArray();
+  writer.Key("color_palette").BeginArray().Value("green").Value("red");
+  writer.EndArray();
+  writer.Key("layers").BeginArray();
+  for (const char* layer :
+       {"bus_lines", "bus_labels", "stop_points", "stop_labels"}) {
+    writer.Value(layer);
+  }
+  writer.EndArray();
+  writer.EndObject();
+
+  writer.Key("base_requests").BeginArray();
+  const int grid_size = static_cast<int>(sqrt(stop_count)) + 1;
+  for (int stop_idx = 0; stop_idx < stop_count; ++stop_idx) {
+    writer.BeginObject().Key("type").Value("Stop");
+    writer.Key("name").Value(MakeStopName(stop_idx));
+    writer.Key("latitude").Value(43.5 + stop_idx / grid_size * 1e-3);
+    writer.Key("longitude").Value(39.6 + stop_idx % grid_size * 1e-3);
+    writer.Key("road_distances").BeginObject();
+    for (int i = 1; i <= kNeighbourCount; ++i) {
+      writer.Key(MakeStopName((stop_idx + i) % stop_count))
+          .Value(100 + (stop_idx * 7 + i * 13) % 900);
+    }
+    writer.EndObject().EndObject();
+  }
+  const int bus_count = stop_count / kBusStride;
+  for (int bus_idx = 0; bus_idx < bus_count; ++bus_idx) {
+    writer.BeginObject().Key("type").Value("Bus");
+    writer.Key("name").Value(to_string(bus_idx));
+    writer.Key("stops").BeginArray();
+    for (int i = 0; i < kRouteLength; ++i) {
+      writer.Value(MakeStopName((bus_idx * kBusStride + i) % stop_count));
+    }
+    writer.EndArray().Key("is_roundtrip").Value(false).EndObject();
+  }
+  writer.EndArray();
+
+  writer.Key("stat_requests").BeginArray();
+  for (int bus_idx = 0; bus_idx < bus_count; ++bus_idx) {
+    writer.BeginObject().Key("id").Value(bus_idx).Key("type").Value("Bus");
+    writer.Key("name").Value(to_string(bus_idx)).EndObject();
+  }
+  writer.EndArray();
+
+  writer.EndObject();
+  return output.Take();
+}
+
+// Reads a string in place, so that allocations and RSS of Json::Load
+// are not those of a copy of the input
+class StringViewBuffer : public streambuf {
+ public:
+  explicit StringViewBuffer(string_view contents) {
+    char* const begin = const_cast<char*>(contents.data());
+    setg(begin, begin, begin + contents.size());
+  }
+};
+
+// In KiB, of the whole process so far
+long GetPeakRss() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+// Growth of the peak RSS over a run of func, in KiB.
+// func runs in a forked child, whose peak starts from the RSS it is
+// forked with, so the peaks of other operations are not counted
+long MeasurePeakRssDelta(const function<void()>& func) {
+  int fds[2];
+  if (pipe(fds) != 0) {
+    throw system_error(errno, generic_category(), "pipe");
+  }
+  const pid_t pid = fork();
+  if (pid < 0) {
+    throw system_error(errno, generic_category(), "fork");
+  }
+  if (pid == 0) {
+    close(fds[0]);
+    const long before = GetPeakRss();
+    func();
+    const long delta = GetPeakRss() - before;
+    const bool is_written = write(fds[1], &delta, sizeof(delta)) ==
+                            static_cast<ssize_t>(sizeof(delta));
+    _exit(is_written ? 0 : 1);
+  }
+  close(fds[1]);
+  long delta = 0;
+  const bool is_read = read(fds[0], &delta, sizeof(delta)) ==
+                       static_cast<ssize_t>(sizeof(delta));
+  close(fds[0]);
+  int status = 0;
+  waitpid(pid, &status, 0);
+  if (!is_read || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    throw runtime_error("RSS measuring child failed");
+  }
+  return delta;
+}
+
+// Best time of Measure, allocations of a run on top of those
+void MeasureCorpus(const string& name, int stop_count, size_t size,
+                   function<void()> func, Json::Writer& results) {
+  // first, so that the heap of the child is not grown by earlier runs
+  const long peak_rss_delta = MeasurePeakRssDelta(func);
+  const Profile::AllocationStats before = Profile::GetAllocationStats();
+  func();
+  const Profile::AllocationStats after = Profile::GetAllocationStats();
+  const double seconds = Measure(func);
+  PrintResult(name, seconds, size);
+
+  results.BeginObject().Key("operation").Value(name);
+  results.Key("stop_count").Value(stop_count);
+  results.Key("bytes").RawValue() << size;
+  results.Key("seconds").Value(seconds);
+  results.Key("mib_per_s").Value(size / seconds / (1 << 20));
+  results.Key("allocations").RawValue() << after.count - before.count;
+  results.Key("allocated_bytes").RawValue() << after.bytes - before.bytes;
+  results.Key("peak_rss_delta_kib").RawValue() << peak_rss_delta;
+  results.EndObject();
+}
+
+// Writes an array of results to the path, one object per operation
+// and corpus
+int BenchmarkCorpora(const char* results_path) {
+  Profile::CountAllocations();
+  ofstream results_file(results_path);
+  if (!results_file) {
+    cerr << "cannot open " << results_path << endl;
+    return 1;
+  }
+  OutputBuffer results_output(results_file);
+  Json::Writer results(results_output);
+  results.BeginArray();
+
+  for (const int stop_count : kCorpusStopCounts) {
+    const string contents = MakeCatalogInput(stop_count);
+    cout << stop_count << " stops, " << contents.size() << " bytes" << endl;
+
+    MeasureCorpus("Json::Load", stop_count, contents.size(),
+                  [&contents] {
+                    StringViewBuffer buffer(contents);
+                    istream input(&buffer);
+                    Json::Load(input);
+                  },
+                  results);
+
+    StringViewBuffer buffer(contents);
+    istream input(&buffer);
+    const Json::Document document = Json::Load(input);
+    size_t output_size = 0;
+    {
+      OutputBuffer output;
+      Json::PrintValue(document.GetRoot().AsMap(), output);
+      output_size = output.GetSize();
+    }
+    MeasureCorpus("Json::PrintValue", stop_count, output_size,
+                  [&document] {
+                    OutputBuffer output;
+                    Json::PrintValue(document.GetRoot().AsMap(), output);
+                  },
+                  results);
+  }
+
+  results.EndArray();
+  results_output << '\n';
+  return 0;
+}
+
+}  // namespace
+
+// Usage:
+//   json_benchmark [input.json...]
+//   json_benchmark --corpus results.json
+int main(int argc, const char* argv[]) {
+  if (argc == 3 && argv[1] == "--corpus"sv) {
+    return BenchmarkCorpora(argv[2]);
+  }
+  BenchmarkNumbers();
+  for (int i = 1; i < argc; ++i) {
+    Benchmark(argv[i]);
+  }
+  return 0;
+}
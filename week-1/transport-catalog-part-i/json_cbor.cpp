@@ -0,0 +1,359 @@
+#include "json_cbor.h"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace Json {
+
+namespace {
+
+enum MajorType : uint8_t {
+  UNSIGNED_INT = 0,
+  NEGATIVE_INT = 1,
+  BYTE_STRING = 2,
+  TEXT_STRING = 3,
+  ARRAY = 4,
+  MAP = 5,
+  TAG = 6,
+  SIMPLE = 7,
+};
+
+const uint8_t kIndefiniteLength = 31;
+
+// Initial byte and the argument in the fewest bytes, big-endian
+void PrintHead(MajorType major_type, uint64_t argument,
+               OutputBuffer& output) {
+  char buffer[9];
+  size_t size;
+  if (argument < 24) {
+    buffer[0] = major_type << 5 | argument;
+    size = 0;
+  } else if (argument <= numeric_limits<uint8_t>::max()) {
+    buffer[0] = major_type << 5 | 24;
+    size = 1;
+  } else if (argument <= numeric_limits<uint16_t>::max()) {
+    buffer[0] = major_type << 5 | 25;
+    size = 2;
+  } else if (argument <= numeric_limits<uint32_t>::max()) {
+    buffer[0] = major_type << 5 | 26;
+    size = 4;
+  } else {
+    buffer[0] = major_type << 5 | 27;
+    size = 8;
+  }
+  for (size_t i = size; i > 0; --i, argument >>= 8) {
+    buffer[i] = static_cast<char>(argument & 0xff);
+  }
+  output << string_view(buffer, size + 1);
+}
+
+class Parser {
+ public:
+  explicit Parser(string_view input)
+      : current_(input.data()), end_(input.data() + input.size()) {}
+
+  Node ParseNode();
+
+ private:
+  uint8_t ReadByte() {
+    if (current_ == end_) {
+      throw invalid_argument("unexpected end of CBOR input");
+    }
+    return static_cast<uint8_t>(*current_++);
+  }
+
+  uint64_t ReadBigEndian(size_t size) {
+    uint64_t result = 0;
+    for (size_t i = 0; i < size; ++i) {
+      result = result << 8 | ReadByte();
+    }
+    return result;
+  }
+
+  uint64_t ReadArgument(uint8_t additional_info);
+
+  // Consumes the break of an indefinite-length item
+  bool TryReadBreak() {
+    if (current_ != end_ && *current_ == kBreak) {
+      ++current_;
+      return true;
+    }
+    return false;
+  }
+
+  // Checks a count against the remaining input before reserving for it:
+  // every item takes a byte at least
+  size_t ReadCount(uint8_t additional_info) {
+    const uint64_t count = ReadArgument(additional_info);
+    if (count > static_cast<uint64_t>(end_ - current_)) {
+      throw invalid_argument("unexpected end of CBOR input");
+    }
+    return count;
+  }
+
+  string ReadString(MajorType major_type, uint8_t additional_info);
+  string ReadKey();
+  Node ReadArray(uint8_t additional_info);
+  Node ReadMap(uint8_t additional_info);
+  Node ReadSimple(uint8_t additional_info);
+
+  static const char kBreak = CborPrivate::kBreak;
+
+  const char* current_;
+  const char* end_;
+};
+
+uint64_t Parser::ReadArgument(uint8_t additional_info) {
+  if (additional_info < 24) {
+    return additional_info;
+  }
+  if (additional_info > 27) {
+    throw invalid_argument("unsupported argument in CBOR input");
+  }
+  return ReadBigEndian(size_t(1) << (additional_info - 24));
+}
+
+string Parser::ReadString(MajorType major_type, uint8_t additional_info) {
+  string result;
+  if (additional_info != kIndefiniteLength) {
+    const size_t size = ReadCount(additional_info);
+    result.assign(current_, size);
+    current_ += size;
+    return result;
+  }
+  // chunks are definite-length strings of the same type
+  while (!TryReadBreak()) {
+    const uint8_t initial_byte = ReadByte();
+    if (initial_byte >> 5 != major_type ||
+        (initial_byte & 0x1f) == kIndefiniteLength) {
+      throw invalid_argument("malformed string chunk in CBOR input");
+    }
+    const size_t size = ReadCount(initial_byte & 0x1f);
+    result.append(current_, size);
+    current_ += size;
+  }
+  return result;
+}
+
+string Parser::ReadKey() {
+  uint8_t initial_byte = ReadByte();
+  while (initial_byte >> 5 == TAG) {
+    ReadArgument(initial_byte & 0x1f);
+    initial_byte = ReadByte();
+  }
+  const auto major_type = static_cast<MajorType>(initial_byte >> 5);
+  if (major_type != TEXT_STRING && major_type != BYTE_STRING) {
+    throw invalid_argument("non-string key in CBOR input");
+  }
+  return ReadString(major_type, initial_byte & 0x1f);
+}
+
+Node Parser::ReadArray(uint8_t additional_info) {
+  vector<Node> result;
+  if (additional_info == kIndefiniteLength) {
+    while (!TryReadBreak()) {
+      result.push_back(ParseNode());
+    }
+  } else {
+    const size_t count = ReadCount(additional_info);
+    result.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+      result.push_back(ParseNode());
+    }
+  }
+  return Node(move(result));
+}
+
+Node Parser::ReadMap(uint8_t additional_info) {
+  vector<Dict::value_type> items;
+  const auto read_item = [this, &items] {
+    string key = ReadKey();
+    items.emplace_back(move(key), ParseNode());
+  };
+  if (additional_info == kIndefiniteLength) {
+    while (!TryReadBreak()) {
+      read_item();
+    }
+  } else {
+    const size_t count = ReadCount(additional_info);
+    items.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+      read_item();
+    }
+  }
+  return Node(Dict(move(items)));
+}
+
+Node Parser::ReadSimple(uint8_t additional_info) {
+  switch (additional_info) {
+    case 20:
+      return Node(false);
+    case 21:
+      return Node(true);
+    case 25: {
+      // half precision: 1 sign bit, 5 exponent bits, 10 mantissa bits
+      const uint64_t half = ReadBigEndian(2);
+      const int exponent = (half >> 10) & 0x1f;
+      const double mantissa = half & 0x3ff;
+      double value;
+      if (exponent == 0) {
+        value = ldexp(mantissa, -24);
+      } else if (exponent == 0x1f) {
+        value = mantissa == 0 ? numeric_limits<double>::infinity()
+                              : numeric_limits<double>::quiet_NaN();
+      } else {
+        value = ldexp(mantissa + 1024, exponent - 25);
+      }
+      return Node(half & 0x8000 ? -value : value);
+    }
+    case 26: {
+      const uint32_t bits = ReadBigEndian(4);
+      float value;
+      memcpy(&value, &bits, sizeof(value));
+      return Node(static_cast<double>(value));
+    }
+    case 27: {
+      const uint64_t bits = ReadBigEndian(8);
+      double value;
+      memcpy(&value, &bits, sizeof(value));
+      return Node(value);
+    }
+    case 22:
+    case 23:
+      throw invalid_argument("null values are not supported");
+    default:
+      throw invalid_argument("unsupported simple value in CBOR input");
+  }
+}
+
+Node Parser::ParseNode() {
+  const uint8_t initial_byte = ReadByte();
+  const auto major_type = static_cast<MajorType>(initial_byte >> 5);
+  const uint8_t additional_info = initial_byte & 0x1f;
+  switch (major_type) {
+    case UNSIGNED_INT: {
+      const uint64_t value = ReadArgument(additional_info);
+      if (value <= numeric_limits<int64_t>::max()) {
+        return Node(static_cast<int64_t>(value));
+      }
+      return Node(static_cast<double>(value));
+    }
+    case NEGATIVE_INT: {
+      // the value is -1 - argument
+      const uint64_t value = ReadArgument(additional_info);
+      if (value <= numeric_limits<int64_t>::max()) {
+        return Node(-1 - static_cast<int64_t>(value));
+      }
+      return Node(-1 - static_cast<double>(value));
+    }
+    case BYTE_STRING:
+    case TEXT_STRING:
+      return Node(ReadString(major_type, additional_info));
+    case ARRAY:
+      return ReadArray(additional_info);
+    case MAP:
+      return ReadMap(additional_info);
+    case TAG:
+      ReadArgument(additional_info);
+      return ParseNode();
+    case SIMPLE:
+      return ReadSimple(additional_info);
+  }
+  throw invalid_argument("unexpected byte in CBOR input");
+}
+
+struct NodePrinter {
+  OutputBuffer& output;
+
+  void operator()(const vector<Node>& items) const {
+    PrintHead(ARRAY, items.size(), output);
+    for (const Node& item : items) {
+      PrintCbor(item, output);
+    }
+  }
+
+  void operator()(const Dict& dict) const {
+    PrintHead(MAP, dict.size(), output);
+    for (const auto& [key, value] : dict) {
+      CborPrivate::PrintString(key, output);
+      PrintCbor(value, output);
+    }
+  }
+
+  void operator()(bool value) const { CborPrivate::PrintBool(value, output); }
+  void operator()(int64_t value) const {
+    CborPrivate::PrintInt(value, output);
+  }
+  void operator()(double value) const {
+    CborPrivate::PrintDouble(value, output);
+  }
+  void operator()(const string& value) const {
+    CborPrivate::PrintString(value, output);
+  }
+};
+
+}  // namespace
+
+Format DetectFormat(string_view input) {
+  if (input.empty()) {
+    return Format::JSON;
+  }
+  const auto major_type = static_cast<uint8_t>(input.front()) >> 5;
+  return major_type == ARRAY || major_type == MAP || major_type == TAG
+             ? Format::CBOR
+             : Format::JSON;
+}
+
+Document LoadCbor(string_view input) {
+  return Document(Parser(input).ParseNode());
+}
+
+void PrintCbor(const Node& node, OutputBuffer& output) {
+  visit(NodePrinter{output}, node.GetBase());
+}
+
+void PrintCbor(const Node& node, ostream& output) {
+  OutputBuffer buffer(output);
+  PrintCbor(node, buffer);
+}
+
+namespace CborPrivate {
+
+void PrintInt(int64_t value, OutputBuffer& output) {
+  if (value >= 0) {
+    PrintHead(UNSIGNED_INT, value, output);
+  } else {
+    // -1 - value without overflow
+    PrintHead(NEGATIVE_INT, ~static_cast<uint64_t>(value), output);
+  }
+}
+
+void PrintDouble(double value, OutputBuffer& output) {
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  char buffer[9] = {static_cast<char>(SIMPLE << 5 | 27)};
+  for (size_t i = 8; i > 0; --i, bits >>= 8) {
+    buffer[i] = static_cast<char>(bits & 0xff);
+  }
+  output << string_view(buffer, sizeof(buffer));
+}
+
+void PrintBool(bool value, OutputBuffer& output) {
+  output << static_cast<char>(SIMPLE << 5 | (value ? 21 : 20));
+}
+
+void PrintString(string_view value, OutputBuffer& output) {
+  PrintHead(TEXT_STRING, value.size(), output);
+  output << value;
+}
+
+}  // namespace CborPrivate
+
+}  // namespace Json
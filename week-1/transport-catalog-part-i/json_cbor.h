@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+
+#include "json.h"
+#include "output_buffer.h"
+
+// CBOR (RFC 8949) for the same nodes: a binary encoding for clients
+// that would rather not print and parse text.
+// CBOR over MessagePack for its indefinite-length containers,
+// which Writer prints without knowing the sizes in advance
+namespace Json {
+
+// By the first byte: CBOR arrays and maps start with bytes
+// that never start JSON text
+Format DetectFormat(std::string_view input);
+
+// Accepts definite and indefinite lengths, floats of every width,
+// byte strings as strings and tagged values, the tags are dropped.
+// Integers beyond int64_t become doubles, as in ParseNumber.
+// There is no null node, so null values throw std::invalid_argument,
+// as does malformed input
+Document LoadCbor(std::string_view input);
+
+// Containers are printed with definite lengths, doubles in 64 bits
+void PrintCbor(const Node& node, OutputBuffer& output);
+void PrintCbor(const Node& node, std::ostream& output);
+
+namespace CborPrivate {
+
+const char kIndefiniteArray = '\x9f';
+const char kIndefiniteMap = '\xbf';
+const char kBreak = '\xff';
+
+void PrintInt(int64_t value, OutputBuffer& output);
+void PrintDouble(double value, OutputBuffer& output);
+void PrintBool(bool value, OutputBuffer& output);
+void PrintString(std::string_view value, OutputBuffer& output);
+
+}  // namespace CborPrivate
+
+}  // namespace Json
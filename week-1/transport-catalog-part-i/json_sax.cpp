@@ -0,0 +1,90 @@
+#include "json_sax.h"
+
+using namespace std;
+
+namespace Json {
+
+const FieldSet::Target* FieldSet::Find(string_view key) const {
+  for (const auto& [target_key, target] : targets_) {
+    if (target_key == key) {
+      return &target;
+    }
+  }
+  return nullptr;
+}
+
+bool FieldSet::Set(string_view key, string_view value) const {
+  const Target* target = Find(key);
+  if (!target) {
+    return false;
+  }
+  *get<string*>(*target) = value;
+  return true;
+}
+
+bool FieldSet::Set(string_view key, Number value) const {
+  const Target* target = Find(key);
+  if (!target) {
+    return false;
+  }
+  if (holds_alternative<double*>(*target)) {
+    *get<double*>(*target) =
+        visit([](auto value) { return static_cast<double>(value); }, value);
+  } else {
+    *get<int*>(*target) = NarrowInt(get<int64_t>(value));
+  }
+  return true;
+}
+
+bool FieldSet::Set(string_view key, bool value) const {
+  const Target* target = Find(key);
+  if (!target) {
+    return false;
+  }
+  *get<bool*>(*target) = value;
+  return true;
+}
+
+namespace {
+
+template <typename T>
+vector<T> MoveOut(vector<T>& stack, size_t begin) {
+  vector<T> result(make_move_iterator(stack.begin() + begin),
+                   make_move_iterator(stack.end()));
+  stack.erase(stack.begin() + begin, stack.end());
+  return result;
+}
+
+}  // namespace
+
+void NodeBuilder::OnEndObject() {
+  Node node(Dict(MoveOut(members_, frames_.back().begin)));
+  frames_.pop_back();
+  Add(move(node));
+}
+
+void NodeBuilder::OnEndArray() {
+  Node node(MoveOut(items_, frames_.back().begin));
+  frames_.pop_back();
+  Add(move(node));
+}
+
+void NodeBuilder::OnNumber(Number value) {
+  Add(visit([](auto value) { return Node(value); }, value));
+}
+
+void NodeBuilder::OnNull() {
+  throw invalid_argument("null is not supported in JSON input");
+}
+
+void NodeBuilder::Add(Node node) {
+  if (frames_.empty()) {
+    result_ = move(node);
+  } else if (frames_.back().is_object) {
+    members_.back().second = move(node);
+  } else {
+    items_.push_back(move(node));
+  }
+}
+
+}  // namespace Json
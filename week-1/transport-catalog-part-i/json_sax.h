@@ -0,0 +1,285 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "json.h"
+
+namespace Json {
+
+using Number = std::variant<int64_t, double>;
+
+// Events of Parse. Handlers derive from this one and hide
+// the events they need, the rest are ignored.
+// Keys and strings are only valid during the call
+struct Handler {
+  void OnStartObject() {}
+  void OnKey(std::string_view) {}
+  void OnEndObject() {}
+  void OnStartArray() {}
+  void OnEndArray() {}
+  void OnString(std::string_view) {}
+  void OnNumber(Number) {}
+  void OnBool(bool) {}
+  void OnNull() {}
+};
+
+// Reads a single value and reports it to the handler as it goes,
+// without building nodes. Numbers are read with ParseNumber,
+// strings are unescaped. Throws std::invalid_argument on malformed input
+template <typename Handler>
+void Parse(std::string_view input, Handler& handler);
+
+// Leaves the input right after the value
+template <typename Handler>
+void Parse(std::istream& input, Handler& handler);
+
+// Typed extraction of scalar fields for handlers:
+// Set stores the value of an event in the variable bound to the key,
+// converting it as Node::As* do, std::bad_variant_access included.
+// Keys are not copied
+class FieldSet {
+ public:
+  using Target = std::variant<std::string*, int*, double*, bool*>;
+
+  FieldSet& Bind(std::string_view key, Target target) {
+    targets_.emplace_back(key, target);
+    return *this;
+  }
+
+  // Return false for keys without a variable
+  bool Set(std::string_view key, std::string_view value) const;
+  bool Set(std::string_view key, Number value) const;
+  bool Set(std::string_view key, bool value) const;
+
+ private:
+  const Target* Find(std::string_view key) const;
+
+  std::vector<std::pair<std::string_view, Target>> targets_;
+};
+
+// Builds a node from the events of a single value.
+// There is no null node, so null values throw std::invalid_argument
+class NodeBuilder : public Handler {
+ public:
+  void OnStartObject() { frames_.push_back({true, members_.size()}); }
+  void OnKey(std::string_view key) { members_.emplace_back(key, Node()); }
+  void OnEndObject();
+  void OnStartArray() { frames_.push_back({false, items_.size()}); }
+  void OnEndArray();
+  void OnString(std::string_view value) { Add(Node(std::string(value))); }
+  void OnNumber(Number value);
+  void OnBool(bool value) { Add(Node(value)); }
+  void OnNull();
+
+  // Leaves the builder ready for the next value
+  Node TakeResult() { return std::move(result_); }
+
+ private:
+  // of an unfinished container
+  struct Frame {
+    bool is_object;
+    size_t begin;  // of its items or members in the stack
+  };
+
+  void Add(Node node);
+
+  std::vector<Frame> frames_;
+  // of the unfinished containers, moved out on close
+  std::vector<Node> items_;
+  std::vector<Dict::value_type> members_;
+  Node result_;
+};
+
+namespace SaxPrivate {
+
+class BufferSource {
+ public:
+  explicit BufferSource(std::string_view input)
+      : current_(input.data()), end_(input.data() + input.size()) {}
+
+  int Peek() const {
+    return current_ < end_ ? static_cast<unsigned char>(*current_) : EOF;
+  }
+  void Skip() { ++current_; }
+
+  // Called after the opening quote
+  std::string_view ReadString() {
+    const char* const begin = current_;
+    const char* end = begin;
+    while (true) {
+      end = static_cast<const char*>(memchr(end, '"', end_ - end));
+      if (!end) {
+        throw std::invalid_argument("unterminated string in JSON input");
+      }
+      // the quote is escaped after an odd number of backslashes
+      const char* backslashes = end;
+      while (backslashes > begin && backslashes[-1] == '\\') {
+        --backslashes;
+      }
+      if ((end - backslashes) % 2 == 0) {
+        break;
+      }
+      ++end;
+    }
+    current_ = end + 1;
+    if (!memchr(begin, '\\', end - begin)) {
+      return {begin, static_cast<size_t>(end - begin)};
+    }
+    buffer_.resize(end - begin);
+    char* const data = buffer_.data();
+    return {data, static_cast<size_t>(Unescape(begin, end, data) - data)};
+  }
+
+  Number ReadNumber() { return ParseNumber(current_, end_); }
+
+ private:
+  const char* current_;
+  const char* end_;
+  std::string buffer_;  // for unescaped strings
+};
+
+// Reads from the stream buffer directly, the istream is not updated
+class StreamSource {
+ public:
+  explicit StreamSource(std::istream& input) : input_(*input.rdbuf()) {}
+
+  int Peek() { return input_.sgetc(); }
+  void Skip() { input_.sbumpc(); }
+
+  std::string_view ReadString() {
+    buffer_.clear();
+    bool has_escapes = false;
+    for (int c; (c = Get()) != '"';) {
+      buffer_.push_back(c);
+      if (c == '\\') {
+        has_escapes = true;
+        buffer_.push_back(Get());
+      }
+    }
+    if (!has_escapes) {
+      return buffer_;
+    }
+    char* const data = buffer_.data();
+    char* const end = Unescape(data, data + buffer_.size(), data);
+    return {data, static_cast<size_t>(end - data)};
+  }
+
+  Number ReadNumber() {
+    return Json::ReadNumber([this] { return Peek(); },
+                            [this] { return input_.sbumpc(); });
+  }
+
+ private:
+  int Get() {
+    const int c = input_.sbumpc();
+    if (c == EOF) {
+      throw std::invalid_argument("unterminated string in JSON input");
+    }
+    return c;
+  }
+
+  std::streambuf& input_;
+  std::string buffer_;
+};
+
+template <typename Source>
+int PeekNonSpace(Source& source) {
+  for (int c = source.Peek();; c = source.Peek()) {
+    if (c != ' ' && c != '\n' && c != '\r' && c != '\t') {
+      return c;
+    }
+    source.Skip();
+  }
+}
+
+template <typename Source>
+void Expect(Source& source, char expected) {
+  if (PeekNonSpace(source) != expected) {
+    throw std::invalid_argument(std::string("expected '") + expected +
+                                "' in JSON input");
+  }
+  source.Skip();
+}
+
+template <typename Source>
+std::string_view ReadLiteral(Source& source, char* buffer, size_t size) {
+  size_t length = 0;
+  while (length < size && isalpha(source.Peek())) {
+    buffer[length++] = source.Peek();
+    source.Skip();
+  }
+  return {buffer, length};
+}
+
+template <typename Source, typename Handler>
+void ParseValue(Source& source, Handler& handler) {
+  const int c = PeekNonSpace(source);
+  if (c == '{') {
+    source.Skip();
+    handler.OnStartObject();
+    for (int next = PeekNonSpace(source); next != '}';
+         next = PeekNonSpace(source)) {
+      if (next == ',') {
+        source.Skip();
+      }
+      Expect(source, '"');
+      handler.OnKey(source.ReadString());
+      Expect(source, ':');
+      ParseValue(source, handler);
+    }
+    source.Skip();
+    handler.OnEndObject();
+  } else if (c == '[') {
+    source.Skip();
+    handler.OnStartArray();
+    for (int next = PeekNonSpace(source); next != ']';
+         next = PeekNonSpace(source)) {
+      if (next == ',') {
+        source.Skip();
+      }
+      ParseValue(source, handler);
+    }
+    source.Skip();
+    handler.OnEndArray();
+  } else if (c == '"') {
+    source.Skip();
+    handler.OnString(source.ReadString());
+  } else if (c == '-' || isdigit(c)) {
+    handler.OnNumber(source.ReadNumber());
+  } else {
+    char buffer[5];
+    const std::string_view literal =
+        ReadLiteral(source, buffer, sizeof(buffer));
+    if (literal == "true" || literal == "false") {
+      handler.OnBool(literal == "true");
+    } else if (literal == "null") {
+      handler.OnNull();
+    } else {
+      throw std::invalid_argument("unexpected literal in JSON input");
+    }
+  }
+}
+
+}  // namespace SaxPrivate
+
+template <typename Handler>
+void Parse(std::string_view input, Handler& handler) {
+  SaxPrivate::BufferSource source(input);
+  SaxPrivate::ParseValue(source, handler);
+}
+
+template <typename Handler>
+void Parse(std::istream& input, Handler& handler) {
+  SaxPrivate::StreamSource source(input);
+  SaxPrivate::ParseValue(source, handler);
+}
+
+}  // namespace Json
@@ -0,0 +1,662 @@
+#include "json_view.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+#include <variant>
+
+#include "json_sax.h"
+#include "thread_pool.h"
+
+using namespace std;
+
+namespace JsonView {
+
+optional<MappedInput> MappedInput::MapRegularFile(int fd) {
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode) ||
+      lseek(fd, 0, SEEK_CUR) != 0) {
+    return nullopt;
+  }
+  MappedInput input;
+  input.size_ = file_stat.st_size;
+  if (input.size_ == 0) {
+    return input;
+  }
+  void* data = mmap(nullptr, input.size_, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_POPULATE, fd, 0);
+  if (data == MAP_FAILED) {
+    return nullopt;
+  }
+  input.data_ = static_cast<char*>(data);
+  input.is_mapped_ = true;
+  return input;
+}
+
+MappedInput MappedInput::FromFile(const string& path) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw system_error(errno, generic_category(), "open " + path);
+  }
+  auto input = MapRegularFile(fd);
+  if (!input) {
+    string contents;
+    char buffer[1 << 16];
+    for (ssize_t size; (size = read(fd, buffer, sizeof(buffer))) > 0;) {
+      contents.append(buffer, size);
+    }
+    input = FromString(contents);
+  }
+  close(fd);  // the mapping stays valid
+  return move(*input);
+}
+
+MappedInput MappedInput::FromString(string_view contents) {
+  MappedInput input;
+  input.copy_.assign(contents.begin(), contents.end());
+  input.data_ = input.copy_.data();
+  input.size_ = input.copy_.size();
+  return input;
+}
+
+MappedInput::MappedInput(MappedInput&& other)
+    : data_(exchange(other.data_, nullptr)),
+      size_(exchange(other.size_, 0)),
+      is_mapped_(exchange(other.is_mapped_, false)),
+      copy_(move(other.copy_)) {}
+
+MappedInput& MappedInput::operator=(MappedInput&& other) {
+  if (this != &other) {
+    if (is_mapped_) {
+      munmap(data_, size_);
+    }
+    data_ = exchange(other.data_, nullptr);
+    size_ = exchange(other.size_, 0);
+    is_mapped_ = exchange(other.is_mapped_, false);
+    copy_ = move(other.copy_);
+  }
+  return *this;
+}
+
+MappedInput::~MappedInput() {
+  if (is_mapped_) {
+    munmap(data_, size_);
+  }
+}
+
+void* Arena::AllocateBytes(size_t size, size_t alignment) {
+  void* pointer = current_;
+  if (!align(alignment, size, pointer, space_left_)) {
+    const size_t block_size = max(kBlockSize, size + alignment);
+    blocks_.push_back(make_unique<char[]>(block_size));
+    pointer = blocks_.back().get();
+    space_left_ = block_size;
+    align(alignment, size, pointer, space_left_);
+  }
+  current_ = static_cast<char*>(pointer) + size;
+  space_left_ -= size;
+  return pointer;
+}
+
+// Input and arena of a document and, in the lazy mode,
+// what the lazy nodes are parsed with
+struct DocumentState {
+  DocumentState(MappedInput input, ParseMode mode)
+      : input(move(input)), mode(mode) {}
+
+  MappedInput input;
+  ParseMode mode;
+  Arena arena;
+  vector<uint32_t> index;
+  // of the closing bracket for every opening one in the index
+  vector<uint32_t> closing_idxs;
+  // guards the arena after the document is built
+  mutex arena_mutex;
+};
+
+struct LazyContainer {
+  LazyContainer(DocumentState* state, uint32_t index_idx)
+      : state(state), index_idx(index_idx) {}
+
+  DocumentState* state;
+  uint32_t index_idx;  // of the opening bracket
+  atomic<bool> is_parsed = false;
+  Node node;
+};
+
+namespace {
+
+const Node& Materialize(LazyContainer& container);
+optional<Json::Node> ConvertUnparsed(LazyContainer& container);
+
+}  // namespace
+
+const Node* Object::find(string_view key) const {
+  for (const Member& member : *this) {
+    if (member.key == key) {
+      return &member.value;
+    }
+  }
+  return nullptr;
+}
+
+const Node& Object::at(string_view key) const {
+  if (const Node* node = find(key)) {
+    return *node;
+  }
+  throw out_of_range("no key " + string(key));
+}
+
+Node Node::MakeArray(const Node* items, size_t size) {
+  Node node(Type::ARRAY);
+  node.items_ = items;
+  node.size_ = size;
+  return node;
+}
+
+Node Node::MakeObject(const Member* members, size_t size) {
+  Node node(Type::OBJECT);
+  node.members_ = members;
+  node.size_ = size;
+  return node;
+}
+
+Node Node::MakeBool(bool value) {
+  Node node(Type::BOOL);
+  node.bool_value_ = value;
+  return node;
+}
+
+Node Node::MakeInt(int64_t value) {
+  Node node(Type::INT);
+  node.int_value_ = value;
+  return node;
+}
+
+Node Node::MakeDouble(double value) {
+  Node node(Type::DOUBLE);
+  node.double_value_ = value;
+  return node;
+}
+
+Node Node::MakeString(string_view value) {
+  Node node(Type::STRING);
+  node.chars_ = value.data();
+  node.size_ = value.size();
+  return node;
+}
+
+Node Node::MakeLazy(Type type, LazyContainer* container) {
+  Node node(type);
+  node.is_lazy_ = true;
+  node.lazy_ = container;
+  return node;
+}
+
+void Node::CheckType(Type type) const {
+  if (type_ != type) {
+    throw bad_variant_access();
+  }
+}
+
+Array Node::AsArray() const {
+  CheckType(Type::ARRAY);
+  if (is_lazy_) {
+    return Materialize(*lazy_).AsArray();
+  }
+  return {items_, size_};
+}
+
+Object Node::AsMap() const {
+  CheckType(Type::OBJECT);
+  if (is_lazy_) {
+    return Materialize(*lazy_).AsMap();
+  }
+  return {members_, size_};
+}
+
+bool Node::AsBool() const {
+  CheckType(Type::BOOL);
+  return bool_value_;
+}
+
+int Node::AsInt() const { return Json::NarrowInt(AsInt64()); }
+
+int64_t Node::AsInt64() const {
+  CheckType(Type::INT);
+  return int_value_;
+}
+
+double Node::AsDouble() const {
+  if (type_ == Type::INT) {
+    return int_value_;
+  }
+  CheckType(Type::DOUBLE);
+  return double_value_;
+}
+
+string_view Node::AsString() const {
+  CheckType(Type::STRING);
+  return {chars_, size_};
+}
+
+Json::Node Node::ToJson() const {
+  if (is_lazy_) {
+    if (auto node = ConvertUnparsed(*lazy_)) {
+      return move(*node);
+    }
+  }
+  switch (type_) {
+    case Type::ARRAY: {
+      const Array items = AsArray();
+      vector<Json::Node> nodes;
+      nodes.reserve(items.size());
+      for (const Node& item : items) {
+        nodes.push_back(item.ToJson());
+      }
+      return nodes;
+    }
+    case Type::OBJECT: {
+      const Object members = AsMap();
+      vector<Json::Dict::value_type> items;
+      items.reserve(members.size());
+      for (const auto& [key, value] : members) {
+        items.emplace_back(string(key), value.ToJson());
+      }
+      return Json::Dict(move(items));
+    }
+    case Type::BOOL:
+      return bool_value_;
+    case Type::INT:
+      return int_value_;
+    case Type::DOUBLE:
+      return double_value_;
+    case Type::STRING:
+      return string(AsString());
+  }
+  return {};
+}
+
+namespace {
+
+// Stage two of parsing: recursive descent over the structural index,
+// which points at every character to look at, so that neither spaces
+// nor string contents are scanned here.
+// Numbers are read with Json::ParseNumber,
+// so that both engines give the same values.
+// In the lazy mode nested containers are skipped
+class Parser {
+ public:
+  explicit Parser(DocumentState& state, size_t index_idx = 0)
+      : state_(state),
+        begin_(state.input.GetData()),
+        current_(begin_),
+        end_(begin_ + state.input.GetSize()),
+        index_(state.index),
+        index_idx_(index_idx),
+        arena_(state.arena) {}
+
+  Node ParseNode();
+  // Of the container at the index position, whatever the mode
+  Node ParseContainer();
+
+ private:
+  char Peek() const { return current_ < end_ ? *current_ : '\0'; }
+  // Moves to the next indexed character and past it
+  char Next();
+  void PutBack() { --index_idx_; }
+  void Expect(char c);
+
+  Node ParseArray();
+  Node ParseObject();
+  Node SkipContainer(Node::Type type);
+  string_view ParseString();
+  Node ParseBool();
+  Node ParseNumber();
+
+  template <typename T>
+  const T* MoveToArena(vector<T>& stack, size_t begin);
+
+  DocumentState& state_;
+  char* begin_;
+  char* current_;
+  char* end_;
+  const vector<uint32_t>& index_;
+  size_t index_idx_;
+  Arena& arena_;
+  // items of the unfinished containers, copied to the arena on close
+  vector<Node> items_stack_;
+  vector<Member> members_stack_;
+};
+
+char Parser::Next() {
+  if (index_idx_ == index_.size()) {
+    throw invalid_argument("unexpected end of JSON input");
+  }
+  current_ = begin_ + index_[index_idx_++];
+  return *current_++;
+}
+
+void Parser::Expect(char c) {
+  if (Next() != c) {
+    throw invalid_argument("expected '"s + c + "' in JSON input");
+  }
+}
+
+Node Parser::ParseNode() {
+  const char c = Next();
+  const bool is_lazy = state_.mode == ParseMode::LAZY;
+  if (c == '[') {
+    return is_lazy ? SkipContainer(Node::Type::ARRAY) : ParseArray();
+  } else if (c == '{') {
+    return is_lazy ? SkipContainer(Node::Type::OBJECT) : ParseObject();
+  } else if (c == '"') {
+    return Node::MakeString(ParseString());
+  } else if (c == 't' || c == 'f') {
+    --current_;
+    return ParseBool();
+  } else {
+    --current_;
+    return ParseNumber();
+  }
+}
+
+Node Parser::ParseContainer() {
+  return Next() == '[' ? ParseArray() : ParseObject();
+}
+
+// Called after the opening bracket
+Node Parser::SkipContainer(Node::Type type) {
+  const size_t opening_idx = index_idx_ - 1;
+  auto* container = new (arena_.Allocate<LazyContainer>(1))
+      LazyContainer(&state_, static_cast<uint32_t>(opening_idx));
+  index_idx_ = state_.closing_idxs[opening_idx] + 1;
+  return Node::MakeLazy(type, container);
+}
+
+template <typename T>
+const T* Parser::MoveToArena(vector<T>& stack, size_t begin) {
+  const size_t size = stack.size() - begin;
+  T* items = arena_.Allocate<T>(size);
+  if (size > 0) {
+    memcpy(static_cast<void*>(items), stack.data() + begin, sizeof(T) * size);
+  }
+  stack.resize(begin);
+  return items;
+}
+
+Node Parser::ParseArray() {
+  const size_t begin = items_stack_.size();
+  for (char c; (c = Next()) != ']';) {
+    if (c != ',') {
+      PutBack();
+    }
+    Node item = ParseNode();
+    items_stack_.push_back(item);
+  }
+  const size_t size = items_stack_.size() - begin;
+  return Node::MakeArray(MoveToArena(items_stack_, begin), size);
+}
+
+Node Parser::ParseObject() {
+  const size_t begin = members_stack_.size();
+  for (char c; (c = Next()) != '}';) {
+    if (c == ',') {
+      c = Next();
+    }
+    if (c != '"') {
+      throw invalid_argument("expected a key in JSON input");
+    }
+    const string_view key = ParseString();
+    Expect(':');
+    Node value = ParseNode();
+    members_stack_.push_back({key, value});
+  }
+  const size_t size = members_stack_.size() - begin;
+  return Node::MakeObject(MoveToArena(members_stack_, begin), size);
+}
+
+// Called after the opening quote, the closing one is the next indexed
+string_view Parser::ParseString() {
+  char* const begin = current_;
+  if (Next() != '"') {
+    throw invalid_argument("unterminated string in JSON input");
+  }
+  char* const end = current_ - 1;
+  if (!memchr(begin, '\\', end - begin)) {
+    return {begin, static_cast<size_t>(end - begin)};
+  }
+
+  // unescaped text is never longer, so it is written over the input
+  char* const output_end = Json::Unescape(begin, end, begin);
+  return {begin, static_cast<size_t>(output_end - begin)};
+}
+
+Node Parser::ParseBool() {
+  const char* const begin = current_;
+  while (current_ < end_ && isalpha(static_cast<unsigned char>(*current_))) {
+    ++current_;
+  }
+  return Node::MakeBool(string_view(begin, current_ - begin) == "true");
+}
+
+Node Parser::ParseNumber() {
+  const char* begin = current_;
+  const auto value = Json::ParseNumber(begin, end_);
+  current_ += begin - current_;
+  if (holds_alternative<int64_t>(value)) {
+    return Node::MakeInt(get<int64_t>(value));
+  }
+  return Node::MakeDouble(get<double>(value));
+}
+
+const Node& Materialize(LazyContainer& container) {
+  if (!container.is_parsed.load(memory_order_acquire)) {
+    lock_guard lock(container.state->arena_mutex);
+    if (!container.is_parsed.load(memory_order_relaxed)) {
+      container.node =
+          Parser(*container.state, container.index_idx).ParseContainer();
+      container.is_parsed.store(true, memory_order_release);
+    }
+  }
+  return container.node;
+}
+
+// Descendants of a container not parsed yet are not parsed either,
+// so its text is still intact and the Json reader builds it
+// without view nodes in between
+optional<Json::Node> ConvertUnparsed(LazyContainer& container) {
+  if (container.is_parsed.load(memory_order_acquire)) {
+    return nullopt;
+  }
+  // keeps Materialize from unescaping the text meanwhile
+  DocumentState& state = *container.state;
+  lock_guard lock(state.arena_mutex);
+  if (container.is_parsed.load(memory_order_relaxed)) {
+    return nullopt;
+  }
+  const uint32_t begin = state.index[container.index_idx];
+  const uint32_t end =
+      state.index[state.closing_idxs[container.index_idx]] + 1;
+  Json::NodeBuilder builder;
+  Json::Parse(string_view(state.input.GetData() + begin, end - begin),
+              builder);
+  return builder.TakeResult();
+}
+
+vector<uint32_t> FindClosingBrackets(const char* input,
+                                     const vector<uint32_t>& index) {
+  vector<uint32_t> closing_idxs(index.size());
+  vector<uint32_t> opening_idxs;
+  for (uint32_t idx = 0; idx < index.size(); ++idx) {
+    const char c = input[index[idx]];
+    if (c == '[' || c == '{') {
+      opening_idxs.push_back(idx);
+    } else if (c == ']' || c == '}') {
+      if (opening_idxs.empty()) {
+        throw invalid_argument("unbalanced brackets in JSON input");
+      }
+      closing_idxs[opening_idxs.back()] = idx;
+      opening_idxs.pop_back();
+    }
+  }
+  if (!opening_idxs.empty()) {
+    throw invalid_argument("unexpected end of JSON input");
+  }
+  return closing_idxs;
+}
+
+}  // namespace
+
+Document::Document(MappedInput input, IndexImplementation implementation,
+                   ParseMode mode)
+    : state_(new DocumentState(move(input), mode)) {
+  const char* const begin = state_->input.GetData();
+  state_->index = BuildStructuralIndex(
+      string_view(begin, state_->input.GetSize()), implementation);
+  if (mode == ParseMode::LAZY) {
+    state_->closing_idxs = FindClosingBrackets(begin, state_->index);
+  }
+  root_ = Parser(*state_).ParseNode();
+  if (mode == ParseMode::EAGER) {
+    state_->index = {};
+  }
+}
+
+Document::Document(Document&& other) = default;
+Document& Document::operator=(Document&& other) = default;
+Document::~Document() = default;
+
+namespace {
+
+// Finds the values at the top of the input with the structural index,
+// leaving their contents to Json::Parse
+class ParallelLoader {
+ public:
+  ParallelLoader(string_view input, ThreadPool& pool)
+      : input_(input),
+        index_(BuildStructuralIndex(input, GetDefaultIndexImplementation())),
+        pool_(pool) {}
+
+  Json::Node Load() {
+    if (Peek() == '{') {
+      return LoadRootObject();
+    } else if (Peek() == '[') {
+      return LoadArray();
+    }
+    return LoadValue();
+  }
+
+ private:
+  char Peek() const {
+    if (index_idx_ == index_.size()) {
+      throw invalid_argument("unexpected end of JSON input");
+    }
+    return input_[index_[index_idx_]];
+  }
+
+  size_t GetOffset() const {
+    return index_idx_ < index_.size() ? index_[index_idx_] : input_.size();
+  }
+
+  void Expect(char c) {
+    if (Peek() != c) {
+      throw invalid_argument("expected '"s + c + "' in JSON input");
+    }
+    ++index_idx_;
+  }
+
+  // Returns the input from the value to the next structural character
+  string_view SkipValue() {
+    const size_t begin = GetOffset();
+    const char c = Peek();
+    if (c == '[' || c == '{') {
+      size_t depth = 0;
+      do {
+        const char next = Peek();
+        ++index_idx_;
+        if (next == '[' || next == '{') {
+          ++depth;
+        } else if (next == ']' || next == '}') {
+          --depth;
+        }
+      } while (depth > 0);
+    } else {
+      // both quotes of a string are indexed
+      index_idx_ += c == '"' ? 2 : 1;
+    }
+    return input_.substr(begin, GetOffset() - begin);
+  }
+
+  Json::Node LoadValue() {
+    Json::Parse(SkipValue(), builder_);
+    return builder_.TakeResult();
+  }
+
+  Json::Node LoadArray() {
+    Expect('[');
+    vector<string_view> items;
+    while (Peek() != ']') {
+      if (Peek() == ',') {
+        ++index_idx_;
+      }
+      items.push_back(SkipValue());
+    }
+    ++index_idx_;
+
+    vector<Json::Node> nodes(items.size());
+    ParallelForDynamic(pool_, items.size(), kChunkSize,
+                       [&items, &nodes](size_t begin, size_t end) {
+                         Json::NodeBuilder builder;
+                         for (size_t i = begin; i < end; ++i) {
+                           Json::Parse(items[i], builder);
+                           nodes[i] = builder.TakeResult();
+                         }
+                       });
+    return nodes;
+  }
+
+  Json::Node LoadRootObject() {
+    Expect('{');
+    vector<Json::Dict::value_type> members;
+    while (Peek() != '}') {
+      if (Peek() == ',') {
+        ++index_idx_;
+      }
+      string key = LoadValue().AsString();
+      Expect(':');
+      Json::Node value = Peek() == '[' ? LoadArray() : LoadValue();
+      members.emplace_back(move(key), move(value));
+    }
+    ++index_idx_;
+    return Json::Dict(move(members));
+  }
+
+  // items handed to a worker at a time
+  static const size_t kChunkSize = 256;
+
+  string_view input_;
+  vector<uint32_t> index_;
+  size_t index_idx_ = 0;
+  ThreadPool& pool_;
+  Json::NodeBuilder builder_;
+};
+
+}  // namespace
+
+Json::Document LoadAsJson(MappedInput input, ThreadPool& pool) {
+  return Json::Document(
+      ParallelLoader(string_view(input.GetData(), input.GetSize()), pool)
+          .Load());
+}
+
+}  // namespace JsonView
@@ -0,0 +1,209 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "json.h"
+#include "structural_index.h"
+
+class ThreadPool;
+
+// Read-only JSON engine for large inputs.
+// The input is memory-mapped, strings are views of it and nodes live
+// in an arena, so loading allocates a few arena blocks and nothing else.
+// Parsing walks a structural index built with SIMD, see BuildStructuralIndex.
+// Accessors mirror Json::Node, with views in place of containers.
+namespace JsonView {
+
+// Whole input in memory: a private mapping of a regular file,
+// or a copy of any other input
+class MappedInput {
+ public:
+  // nullopt unless fd is a regular file not read from yet
+  static std::optional<MappedInput> MapRegularFile(int fd);
+  static MappedInput FromFile(const std::string& path);
+  static MappedInput FromString(std::string_view contents);
+
+  MappedInput(MappedInput&& other);
+  MappedInput& operator=(MappedInput&& other);
+  ~MappedInput();
+
+  // Writable: private mapping pages are copied on write
+  char* GetData() { return data_; }
+  size_t GetSize() const { return size_; }
+
+ private:
+  MappedInput() = default;
+
+  char* data_ = nullptr;
+  size_t size_ = 0;
+  bool is_mapped_ = false;
+  std::vector<char> copy_;
+};
+
+// Bump allocator for trivially destructible objects,
+// which are freed all at once with the arena
+class Arena {
+ public:
+  template <typename T>
+  T* Allocate(size_t count);
+
+ private:
+  static constexpr size_t kBlockSize = 1 << 16;
+
+  void* AllocateBytes(size_t size, size_t alignment);
+
+  std::vector<std::unique_ptr<char[]>> blocks_;
+  char* current_ = nullptr;
+  size_t space_left_ = 0;
+};
+
+class Array;
+class Object;
+struct Member;
+struct LazyContainer;
+struct DocumentState;
+
+class Node {
+ public:
+  enum class Type : uint8_t { ARRAY, OBJECT, BOOL, INT, DOUBLE, STRING };
+
+  Node() : Node(Type::INT) {}
+
+  static Node MakeArray(const Node* items, size_t size);
+  static Node MakeObject(const Member* members, size_t size);
+  static Node MakeBool(bool value);
+  static Node MakeInt(int64_t value);
+  static Node MakeDouble(double value);
+  static Node MakeString(std::string_view value);
+  // Array or object to be parsed on the first access
+  static Node MakeLazy(Type type, LazyContainer* container);
+
+  Type GetType() const { return type_; }
+
+  // Throw std::bad_variant_access for other types, as Json::Node does
+  Array AsArray() const;
+  Object AsMap() const;
+  bool AsBool() const;
+  // Throws std::out_of_range for integers beyond int
+  int AsInt() const;
+  int64_t AsInt64() const;
+  double AsDouble() const;
+  std::string_view AsString() const;
+
+  // Lazy containers not parsed yet are read from the input
+  // into Json nodes directly, without parsing them into views
+  Json::Node ToJson() const;
+
+ private:
+  explicit Node(Type type)
+      : type_(type), is_lazy_(false), size_(0), int_value_(0) {}
+
+  void CheckType(Type type) const;
+
+  Type type_;
+  bool is_lazy_;
+  uint32_t size_;  // of an array, an object or a string
+  union {
+    LazyContainer* lazy_;
+    const Node* items_;
+    const Member* members_;
+    const char* chars_;
+    bool bool_value_;
+    int64_t int_value_;
+    double double_value_;
+  };
+};
+
+struct Member {
+  std::string_view key;
+  Node value;
+};
+
+class Array {
+ public:
+  Array() = default;
+  Array(const Node* items, size_t size) : items_(items), size_(size) {}
+
+  const Node* begin() const { return items_; }
+  const Node* end() const { return items_ + size_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  const Node& operator[](size_t idx) const { return items_[idx]; }
+
+ private:
+  const Node* items_ = nullptr;
+  size_t size_ = 0;
+};
+
+// Members in the input order.
+// Lookups scan: objects of the catalog input have a handful of keys
+class Object {
+ public:
+  Object() = default;
+  Object(const Member* members, size_t size)
+      : members_(members), size_(size) {}
+
+  const Member* begin() const { return members_; }
+  const Member* end() const { return members_ + size_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  // nullptr if there is no such key
+  const Node* find(std::string_view key) const;
+  size_t count(std::string_view key) const { return find(key) ? 1 : 0; }
+  // Throws std::out_of_range if there is no such key
+  const Node& at(std::string_view key) const;
+
+ private:
+  const Member* members_ = nullptr;
+  size_t size_ = 0;
+};
+
+enum class ParseMode {
+  EAGER,
+  // Arrays and objects are only located, with a jump over the structural
+  // index, and parsed one level at a time on the first AsArray or AsMap.
+  // Work then follows the part of the input that is accessed.
+  // Lazy nodes may be accessed from several threads
+  LAZY,
+};
+
+// Owns the input and the arena its nodes point into,
+// so nodes are valid for as long as the document is
+class Document {
+ public:
+  // Strings with escapes are unescaped in place, the rest stay as they are
+  explicit Document(
+      MappedInput input,
+      IndexImplementation implementation = GetDefaultIndexImplementation(),
+      ParseMode mode = ParseMode::EAGER);
+  Document(Document&& other);
+  Document& operator=(Document&& other);
+  ~Document();
+
+  const Node& GetRoot() const { return root_; }
+
+ private:
+  std::unique_ptr<DocumentState> state_;
+  Node root_;
+};
+
+// Alternative backend of Json::Load for whole files.
+// Elements of the arrays at the top, the root or its members,
+// are located with the structural index and parsed by the pool workers
+Json::Document LoadAsJson(MappedInput input, ThreadPool& pool);
+
+template <typename T>
+T* Arena::Allocate(size_t count) {
+  static_assert(std::is_trivially_destructible_v<T>);
+  return static_cast<T*>(AllocateBytes(sizeof(T) * count, alignof(T)));
+}
+
+}  // namespace JsonView
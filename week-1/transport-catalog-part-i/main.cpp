@@ -1,9 +1,26 @@
+#include <pthread.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <csignal>
+#include <exception>
 #include <iostream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <thread>
 
+#include "catalog_holder.h"
 #include "descriptions.h"
 #include "json.h"
+#include "json_cbor.h"
+#include "json_view.h"
+#include "output_buffer.h"
+#include "profile.h"
 #include "renderer.h"
 #include "requests.h"
+#include "server.h"
+#include "thread_pool.h"
 #include "transport_catalog.h"
 
 #ifdef TESTS
@@ -12,22 +29,198 @@
 
 using namespace std;
 
-int main() {
+namespace {
+
+// Input of serve mode: stat_requests of the file are not served,
+// so they are never parsed
+Json::Dict LoadServedInput(const char* input_path) {
+  Profile::PhaseTimer timer("parse");
+  const JsonView::Document document(
+      JsonView::MappedInput::FromFile(input_path),
+      JsonView::GetDefaultIndexImplementation(), JsonView::ParseMode::LAZY);
+  Json::Dict input_map;
+  for (const auto& [key, value] : document.GetRoot().AsMap()) {
+    if (key != "stat_requests") {
+      input_map.emplace(string(key), value.ToJson());
+    }
+  }
+  return input_map;
+}
+
+// Rebuilds the catalog from the input file on every SIGHUP, while
+// requests go on being served from the previous one. Construct it
+// before any other thread, so that SIGHUP is blocked in all of them
+// and only taken here
+class HangupReloader {
+ public:
+  HangupReloader(CatalogHolder& catalog, const char* input_path) {
+    sigemptyset(&hangup_);
+    sigaddset(&hangup_, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &hangup_, nullptr);
+    thread_ = thread([this, &catalog, input_path] {
+      for (int signal; sigwait(&hangup_, &signal) == 0 && !is_stopped_;) {
+        try {
+          catalog.Refresh(Json::Document(LoadServedInput(input_path))).get();
+        } catch (const exception& e) {
+          // the previous catalog stays
+          cerr << "cannot reload " << input_path << ": " << e.what() << endl;
+        }
+      }
+    });
+  }
+
+  ~HangupReloader() {
+    is_stopped_ = true;
+    pthread_kill(thread_.native_handle(), SIGHUP);
+    thread_.join();
+  }
+
+  HangupReloader(const HangupReloader&) = delete;
+  HangupReloader& operator=(const HangupReloader&) = delete;
+
+ private:
+  sigset_t hangup_;
+  atomic<bool> is_stopped_ = false;
+  thread thread_;
+};
+
+// Builds the catalog from the input file and serves stat requests
+// of stdin or of the socket, see RequestServer
+int Serve(const char* input_path, const char* socket_path) {
+  Json::Dict input_map = LoadServedInput(input_path);
+  const size_t worker_count =
+      Requests::ReadWorkerCount(Requests::GetServingSettings(input_map));
+  CatalogHolder catalog(CatalogHolder::Build(move(input_map)));
+  const HangupReloader reloader(catalog, input_path);
+  RequestServer server(catalog, worker_count);
+  if (socket_path) {
+    server.ServeUnixSocket(socket_path);
+  } else {
+    server.Serve(cin, cout);
+  }
+  Profile::WriteReport();
+  return 0;
+}
+
+// The whole input is at hand, so it is parsed into JsonView nodes
+// rather than read as a stream. Requests are processed as Json nodes:
+// the lazy mode leaves stat_requests to ToJson, which builds them
+// from the input once
+void ProcessMappedInput(JsonView::MappedInput input) {
+  const JsonView::Document document = [&input] {
+    Profile::PhaseTimer timer("parse");
+    return JsonView::Document(move(input),
+                              JsonView::GetDefaultIndexImplementation(),
+                              JsonView::ParseMode::LAZY);
+  }();
+  const auto input_map = document.GetRoot().AsMap();
+
+  auto descriptions = [&input_map] {
+    Profile::PhaseTimer timer("describe");
+    return Descriptions::ReadDescriptions(
+        input_map.at("base_requests").AsArray());
+  }();
+  const auto* serving_settings_node = input_map.find("serving_settings");
+  const Json::Dict serving_settings =
+      serving_settings_node ? serving_settings_node->ToJson().AsMap()
+                            : Json::Dict{};
+  ThreadPool pool(Requests::ReadWorkerCount(serving_settings));
+  const TransportCatalog db(
+      move(descriptions), input_map.at("routing_settings").ToJson().AsMap(),
+      input_map.at("render_settings").ToJson().AsMap(), serving_settings,
+      pool);
+
+  Profile::PhaseTimer timer("respond");
+  const Json::Node requests = input_map.at("stat_requests").ToJson();
+  OutputBuffer output(STDOUT_FILENO);
+  Requests::ProcessAll(db, requests.AsArray(), output,
+                       Requests::ReadWorkerCount(serving_settings));
+  output << '\n';
+  output.Flush();
+}
+
+// Builds the catalog from the parsed input and answers its stat_requests.
+// CBOR input gets CBOR output, without the trailing newline
+void ProcessInputMap(Json::Dict input_map, Json::Format format) {
+  auto descriptions = [&input_map] {
+    Profile::PhaseTimer timer("describe");
+    return Descriptions::ReadDescriptions(
+        move(input_map.at("base_requests")).TakeArray());
+  }();
+  const Json::Dict serving_settings = Requests::GetServingSettings(input_map);
+  ThreadPool pool(Requests::ReadWorkerCount(serving_settings));
+  const TransportCatalog db(
+      move(descriptions), input_map.at("routing_settings").AsMap(),
+      input_map.at("render_settings").AsMap(), serving_settings, pool);
+
+  Profile::PhaseTimer timer("respond");
+  OutputBuffer output(STDOUT_FILENO);
+  Requests::ProcessAll(db, input_map.at("stat_requests").AsArray(), output,
+                       Requests::ReadWorkerCount(serving_settings), format);
+  if (format == Json::Format::JSON) {
+    output << '\n';
+  }
+  output.Flush();
+}
+
+Json::Dict LoadCborInput(string_view input) {
+  Profile::PhaseTimer timer("parse");
+  return Json::LoadCbor(input).TakeRoot().TakeMap();
+}
+
+// The top-level arrays are parsed by the pool, see JsonView::LoadAsJson
+Json::Dict LoadInParallel(JsonView::MappedInput input, size_t thread_count) {
+  Profile::PhaseTimer timer("parse");
+  ThreadPool pool(thread_count);
+  return JsonView::LoadAsJson(move(input), pool).TakeRoot().TakeMap();
+}
+
+}  // namespace
+
+// Usage:
+//   transport_catalog < input.json
+//   transport_catalog < input.cbor
+//   transport_catalog serve input.json [socket_path]
+//     kill -HUP rebuilds the served catalog from input.json
+int main(int argc, const char* argv[]) {
 #ifdef TESTS
   RunTests();
 #endif  // TESTS
 
-  const auto input_doc = Json::Load(cin);
-  const auto& input_map = input_doc.GetRoot().AsMap();
+  if (argc >= 3 && argv[1] == "serve"sv) {
+    return Serve(argv[2], argc >= 4 ? argv[3] : nullptr);
+  }
 
-  const TransportCatalog db(
-      Descriptions::ReadDescriptions(input_map.at("base_requests").AsArray()),
-      input_map.at("routing_settings").AsMap(),
-      input_map.at("render_settings").AsMap());
+  if (auto input = JsonView::MappedInput::MapRegularFile(STDIN_FILENO)) {
+    const string_view contents(input->GetData(), input->GetSize());
+    // serving_settings is not read yet, so the number of threads
+    // parsing the input comes from the environment
+    const size_t worker_count = Requests::ReadWorkerCount({});
+    if (Json::DetectFormat(contents) == Json::Format::CBOR) {
+      ProcessInputMap(LoadCborInput(contents), Json::Format::CBOR);
+    } else if (worker_count > 1) {
+      ProcessInputMap(LoadInParallel(move(*input), worker_count),
+                      Json::Format::JSON);
+    } else {
+      ProcessMappedInput(move(*input));
+    }
+    Profile::WriteReport();
+    return 0;
+  }
+
+  if (const char first_byte = cin.peek();
+      cin && Json::DetectFormat({&first_byte, 1}) == Json::Format::CBOR) {
+    ProcessInputMap(LoadCborInput(string(istreambuf_iterator<char>(cin), {})),
+                    Json::Format::CBOR);
+    Profile::WriteReport();
+    return 0;
+  }
 
-  Json::PrintValue(
-      Requests::ProcessAll(db, input_map.at("stat_requests").AsArray()), cout);
-  cout << endl;
+  OutputBuffer output(STDOUT_FILENO);
+  Requests::ProcessInput(cin, output);
+  output << '\n';
+  output.Flush();
+  Profile::WriteReport();
 
   return 0;
 }
@@ -0,0 +1,74 @@
+#include "output_buffer.h"
+
+#include <unistd.h>
+
+#include <cerrno>
+#include <charconv>
+#include <sstream>
+#include <system_error>
+#include <utility>
+
+using namespace std;
+
+OutputBuffer::~OutputBuffer() {
+  try {
+    Flush();
+  } catch (const system_error&) {
+  }
+}
+
+OutputBuffer& OutputBuffer::operator<<(double value) {
+  char buffer[64];
+  const auto result = to_chars(buffer, buffer + sizeof(buffer), value,
+                               chars_format::general, precision_);
+  if (result.ec != errc{}) {
+    // too many digits for the buffer
+    ostringstream output;
+    output.precision(precision_);
+    output << value;
+    return *this << output.str();
+  }
+  data_.append(buffer, result.ptr);
+  return MaybeFlush();
+}
+
+OutputBuffer& OutputBuffer::AppendInt(int64_t value) {
+  char buffer[24];
+  const auto result = to_chars(buffer, buffer + sizeof(buffer), value);
+  data_.append(buffer, result.ptr);
+  return MaybeFlush();
+}
+
+OutputBuffer& OutputBuffer::AppendUnsigned(uint64_t value) {
+  char buffer[24];
+  const auto result = to_chars(buffer, buffer + sizeof(buffer), value);
+  data_.append(buffer, result.ptr);
+  return MaybeFlush();
+}
+
+string OutputBuffer::Take() {
+  string result = move(data_);
+  data_.clear();
+  return result;
+}
+
+void OutputBuffer::Flush() {
+  if (output_) {
+    output_->write(data_.data(), data_.size());
+    data_.clear();
+  } else if (fd_ >= 0) {
+    // the whole chunk in a single write, unless the fd takes less
+    for (size_t offset = 0; offset < data_.size();) {
+      const ssize_t written =
+          write(fd_, data_.data() + offset, data_.size() - offset);
+      if (written < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        throw system_error(errno, generic_category(), "write");
+      }
+      offset += written;
+    }
+    data_.clear();
+  }
+}
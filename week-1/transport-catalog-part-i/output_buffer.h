@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// Growable byte buffer for the JSON and SVG printers: appends are plain
+// copies, without the sentry and the virtual calls of std::ostream.
+// A buffer with a sink is flushed to it in chunks of kFlushSize,
+// one without a sink keeps everything for View and Take.
+// Doubles are printed as operator<< of std::ostream prints them
+class OutputBuffer {
+ public:
+  static const size_t kFlushSize = 1 << 20;
+
+  OutputBuffer() = default;
+  explicit OutputBuffer(int fd) : fd_(fd), flush_size_(kFlushSize) {}
+  // With the precision of the stream
+  explicit OutputBuffer(std::ostream& output)
+      : output_(&output),
+        flush_size_(kFlushSize),
+        precision_(output.precision()) {}
+
+  // Errors of this last flush are lost, Flush reports them
+  ~OutputBuffer();
+
+  OutputBuffer(const OutputBuffer&) = delete;
+  OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+  OutputBuffer& operator<<(std::string_view value) {
+    data_.append(value);
+    return MaybeFlush();
+  }
+  OutputBuffer& operator<<(const char* value) {
+    return *this << std::string_view(value);
+  }
+  OutputBuffer& operator<<(const std::string& value) {
+    return *this << std::string_view(value);
+  }
+  OutputBuffer& operator<<(char value) {
+    data_.push_back(value);
+    return MaybeFlush();
+  }
+  OutputBuffer& operator<<(double value);
+
+  template <typename Int>
+  std::enable_if_t<std::is_integral_v<Int>, OutputBuffer&> operator<<(
+      Int value) {
+    return std::is_signed_v<Int> ? AppendInt(value)
+                                 : AppendUnsigned(value);
+  }
+
+  // Bytes that have not been flushed yet
+  std::string_view View() const { return data_; }
+  size_t GetSize() const { return data_.size(); }
+  std::string Take();
+  void Clear() { data_.clear(); }
+
+  void SetPrecision(int precision) { precision_ = precision; }
+  int GetPrecision() const { return precision_; }
+
+  // Throws std::system_error if the sink is a file descriptor
+  // that fails to take the data
+  void Flush();
+
+ private:
+  OutputBuffer& AppendInt(int64_t value);
+  OutputBuffer& AppendUnsigned(uint64_t value);
+
+  OutputBuffer& MaybeFlush() {
+    if (data_.size() >= flush_size_) {
+      Flush();
+    }
+    return *this;
+  }
+
+  std::string data_;
+  int fd_ = -1;
+  std::ostream* output_ = nullptr;
+  size_t flush_size_ = std::numeric_limits<size_t>::max();
+  int precision_ = 6;
+};
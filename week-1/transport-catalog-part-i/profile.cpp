@@ -0,0 +1,287 @@
+#include "profile.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+
+#include "json.h"
+#include "output_buffer.h"
+
+using namespace std;
+
+namespace Profile {
+
+namespace {
+
+const char* const kProfileVariable = "TRANSPORT_CATALOG_PROFILE";
+
+}  // namespace
+
+namespace Private {
+
+// Zero-initialized before any dynamic initialization,
+// so allocations of static constructors that run earlier are not counted
+const bool is_enabled = getenv(kProfileVariable) != nullptr;
+
+}  // namespace Private
+
+namespace {
+
+using Private::is_enabled;
+
+bool is_counting_allocations = is_enabled;
+
+atomic<uint64_t> allocation_count = 0;
+atomic<uint64_t> allocated_bytes = 0;
+
+struct PhaseStats {
+  uint64_t count = 0;
+  Clock::duration total{};
+};
+
+struct Registry {
+  mutex phases_mutex;
+  map<string, PhaseStats> phases;
+
+  mutex requests_mutex;
+  map<string, unique_ptr<LatencyHistogram>> requests;
+};
+
+Registry& GetRegistry() {
+  static Registry registry;
+  return registry;
+}
+
+double ToMicroseconds(uint64_t nanoseconds) { return nanoseconds / 1000.0; }
+
+}  // namespace
+
+PhaseTimer::PhaseTimer(const char* phase) : phase_(phase) {
+  if (is_enabled) {
+    start_ = Clock::now();
+  }
+}
+
+PhaseTimer::~PhaseTimer() {
+  if (!is_enabled) {
+    return;
+  }
+  const auto duration = Clock::now() - start_;
+  auto& registry = GetRegistry();
+  lock_guard lock(registry.phases_mutex);
+  auto& stats = registry.phases[phase_];
+  ++stats.count;
+  stats.total += duration;
+}
+
+void LatencyHistogram::Record(uint64_t nanoseconds) {
+  counts_[GetBucketIdx(nanoseconds)].fetch_add(1, memory_order_relaxed);
+  total_count_.fetch_add(1, memory_order_relaxed);
+  total_.fetch_add(nanoseconds, memory_order_relaxed);
+  uint64_t max = max_.load(memory_order_relaxed);
+  while (nanoseconds > max &&
+         !max_.compare_exchange_weak(max, nanoseconds,
+                                     memory_order_relaxed)) {
+  }
+}
+
+uint64_t LatencyHistogram::GetCount() const {
+  return total_count_.load(memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::GetMax() const {
+  return max_.load(memory_order_relaxed);
+}
+
+double LatencyHistogram::GetMean() const {
+  const uint64_t count = GetCount();
+  return count ? static_cast<double>(total_.load(memory_order_relaxed)) / count
+               : 0.0;
+}
+
+uint64_t LatencyHistogram::GetValueAtQuantile(double quantile) const {
+  const uint64_t count = GetCount();
+  if (count == 0) {
+    return 0;
+  }
+  const uint64_t rank =
+      max<uint64_t>(1, static_cast<uint64_t>(quantile * count + 0.5));
+  uint64_t seen = 0;
+  for (size_t i = 0; i < kBucketCount; ++i) {
+    seen += counts_[i].load(memory_order_relaxed);
+    if (seen >= rank) {
+      return i + 1 < kBucketCount
+                 ? min(GetBucketLowerBound(i + 1) - 1, GetMax())
+                 : GetMax();
+    }
+  }
+  return GetMax();
+}
+
+// static
+size_t LatencyHistogram::GetBucketIdx(uint64_t value) {
+  if (value < kSubBucketCount) {
+    return value;
+  }
+  const int exponent = 63 - __builtin_clzll(value);
+  const uint64_t sub_bucket =
+      (value >> (exponent - kSubBucketBits)) & (kSubBucketCount - 1);
+  return (exponent - kSubBucketBits + 1) * kSubBucketCount + sub_bucket;
+}
+
+// static
+uint64_t LatencyHistogram::GetBucketLowerBound(size_t bucket_idx) {
+  if (bucket_idx < kSubBucketCount) {
+    return bucket_idx;
+  }
+  const int exponent = bucket_idx / kSubBucketCount + kSubBucketBits - 1;
+  const uint64_t sub_bucket = bucket_idx % kSubBucketCount;
+  return (kSubBucketCount + sub_bucket) << (exponent - kSubBucketBits);
+}
+
+LatencyHistogram& GetRequestHistogram(const string& request_type) {
+  // histograms are never removed, so workers keep them without locking
+  thread_local map<string, LatencyHistogram*, less<>> cache;
+  if (const auto it = cache.find(request_type); it != cache.end()) {
+    return *it->second;
+  }
+
+  auto& registry = GetRegistry();
+  lock_guard lock(registry.requests_mutex);
+  auto& histogram = registry.requests[request_type];
+  if (!histogram) {
+    histogram = make_unique<LatencyHistogram>();
+  }
+  cache.emplace(request_type, histogram.get());
+  return *histogram;
+}
+
+void CountAllocations() { is_counting_allocations = true; }
+
+AllocationStats GetAllocationStats() {
+  return {
+      .count = allocation_count.load(memory_order_relaxed),
+      .bytes = allocated_bytes.load(memory_order_relaxed),
+  };
+}
+
+void PrintReport(ostream& output) {
+  auto& registry = GetRegistry();
+  OutputBuffer buffer(output);
+  Json::Writer writer(buffer);
+  writer.BeginObject();
+
+  const AllocationStats allocations = GetAllocationStats();
+  writer.Key("allocations").BeginObject().Key("bytes").RawValue()
+      << allocations.bytes;
+  writer.Key("count").RawValue() << allocations.count;
+  writer.EndObject();
+
+  writer.Key("phases").BeginObject();
+  {
+    lock_guard lock(registry.phases_mutex);
+    for (const auto& [phase, stats] : registry.phases) {
+      writer.Key(phase).BeginObject().Key("count").RawValue() << stats.count;
+      writer.Key("total_ms")
+          .Value(chrono::duration<double, milli>(stats.total).count())
+          .EndObject();
+    }
+  }
+  writer.EndObject();
+
+  writer.Key("requests").BeginObject();
+  {
+    lock_guard lock(registry.requests_mutex);
+    for (const auto& [request_type, histogram] : registry.requests) {
+      writer.Key(request_type).BeginObject().Key("count").RawValue()
+          << histogram->GetCount();
+      writer.Key("max_us")
+          .Value(ToMicroseconds(histogram->GetMax()))
+          .Key("mean_us")
+          .Value(histogram->GetMean() / 1000.0)
+          .Key("p50_us")
+          .Value(ToMicroseconds(histogram->GetValueAtQuantile(0.5)))
+          .Key("p90_us")
+          .Value(ToMicroseconds(histogram->GetValueAtQuantile(0.9)))
+          .Key("p99_us")
+          .Value(ToMicroseconds(histogram->GetValueAtQuantile(0.99)))
+          .Key("p999_us")
+          .Value(ToMicroseconds(histogram->GetValueAtQuantile(0.999)))
+          .EndObject();
+    }
+  }
+  writer.EndObject();
+
+  writer.EndObject();
+  buffer << '\n';
+}
+
+void WriteReport() {
+  if (!is_enabled) {
+    return;
+  }
+  const string destination = getenv(kProfileVariable);
+  if (destination == "stderr" || destination.empty()) {
+    PrintReport(cerr);
+  } else {
+    ofstream output(destination);
+    PrintReport(output);
+  }
+}
+
+}  // namespace Profile
+
+namespace {
+
+void CountAllocation(size_t size) {
+  if (Profile::is_counting_allocations) {
+    Profile::allocation_count.fetch_add(1, memory_order_relaxed);
+    Profile::allocated_bytes.fetch_add(size, memory_order_relaxed);
+  }
+}
+
+}  // namespace
+
+// Replaced for the allocation stats.
+// The array and nothrow forms go through these
+
+void* operator new(size_t size) {
+  CountAllocation(size);
+  if (void* pointer = malloc(size ? size : 1)) {
+    return pointer;
+  }
+  throw bad_alloc();
+}
+
+void* operator new(size_t size, align_val_t alignment) {
+  CountAllocation(size);
+  const auto align = static_cast<size_t>(alignment);
+  // aligned_alloc wants a multiple of the alignment
+  const size_t aligned_size = (max<size_t>(size, 1) + align - 1) & ~(align - 1);
+  if (void* pointer = aligned_alloc(align, aligned_size)) {
+    return pointer;
+  }
+  throw bad_alloc();
+}
+
+// Not inlined into the containers of this file: GCC would take the free
+// for a mismatch with the builtin operator new
+[[gnu::noinline]] void operator delete(void* pointer) noexcept {
+  free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+  operator delete(pointer);
+}
+
+void operator delete(void* pointer, align_val_t) noexcept {
+  operator delete(pointer);
+}
+
+void operator delete(void* pointer, size_t, align_val_t) noexcept {
+  operator delete(pointer);
+}
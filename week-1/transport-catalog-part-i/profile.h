@@ -0,0 +1,88 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+// Instrumentation of where the time and memory go.
+// Enabled by the TRANSPORT_CATALOG_PROFILE environment variable:
+// "stderr" or the path of a file for the JSON report.
+// When disabled every hook below is a single branch.
+namespace Profile {
+
+namespace Private {
+extern const bool is_enabled;
+}  // namespace Private
+
+inline bool IsEnabled() { return Private::is_enabled; }
+
+using Clock = std::chrono::steady_clock;
+
+// Adds the lifetime of the object to the total of the phase.
+// Phases may nest and run concurrently: totals are sums over threads
+class PhaseTimer {
+ public:
+  explicit PhaseTimer(const char* phase);
+  ~PhaseTimer();
+
+  PhaseTimer(const PhaseTimer&) = delete;
+  PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+ private:
+  const char* phase_;
+  Clock::time_point start_;
+};
+
+// HDR-style histogram of durations in nanoseconds: every power of two
+// is split into kSubBucketCount linear buckets, so any value is kept
+// within 1 / kSubBucketCount of relative error.
+// Recording is lock-free and may be concurrent
+class LatencyHistogram {
+ public:
+  void Record(uint64_t nanoseconds);
+
+  uint64_t GetCount() const;
+  uint64_t GetMax() const;
+  double GetMean() const;
+  // Highest value of the bucket holding the quantile, 0 when empty
+  uint64_t GetValueAtQuantile(double quantile) const;
+
+  static size_t GetBucketIdx(uint64_t value);
+  static uint64_t GetBucketLowerBound(size_t bucket_idx);
+
+ private:
+  static const int kSubBucketBits = 4;
+  static const uint64_t kSubBucketCount = 1 << kSubBucketBits;
+  static const size_t kBucketCount =
+      (64 - kSubBucketBits + 1) * kSubBucketCount;
+
+  std::array<std::atomic<uint64_t>, kBucketCount> counts_{};
+  std::atomic<uint64_t> total_count_ = 0;
+  std::atomic<uint64_t> total_ = 0;
+  std::atomic<uint64_t> max_ = 0;
+};
+
+// The same histogram for every call with the name
+LatencyHistogram& GetRequestHistogram(const std::string& request_type);
+
+// Allocations through global operator new since the start
+struct AllocationStats {
+  uint64_t count = 0;
+  uint64_t bytes = 0;
+};
+
+AllocationStats GetAllocationStats();
+
+// Counts allocations with profiling disabled too, for benchmarks.
+// Call before starting threads
+void CountAllocations();
+
+void PrintReport(std::ostream& output);
+
+// To stderr or the file of TRANSPORT_CATALOG_PROFILE, if enabled
+void WriteReport();
+
+}  // namespace Profile
@@ -134,9 +134,9 @@ Renderer::Renderer(const Descriptions::StopsDict& stops_dict,
     }
   }
 
-  std::stringstream stream;
-  document.Render(stream);
-  result_ = stream.str();
+  OutputBuffer output;
+  document.Render(output);
+  result_ = output.Take();
 }
 void Renderer::RenderStopLabels(
     const std::map<std::string, Svg::Point>& stop_to_point,
@@ -1,83 +1,158 @@
 #include "requests.h"
 
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <future>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
+#include "json_sax.h"
+#include "profile.h"
+#include "spsc_queue.h"
+#include "thread_pool.h"
 #include "transport_router.h"
 
 using namespace std;
 
 namespace Requests {
 
-Json::Dict Stop::Process(const TransportCatalog& db) const {
+namespace {
+
+void WriteNotFound(optional<int> request_id, Json::Writer& writer) {
+  writer.BeginObject()
+      .Key("error_message")
+      .Value("not found");
+  Responses::WriteRequestId(writer, request_id);
+  writer.EndObject();
+}
+
+}  // namespace
+
+// Keys of every response go in the sorted order of Json::Dict
+
+void Stop::Process(const TransportCatalog& db, optional<int> request_id,
+                   Json::Writer& writer) const {
   const auto* stop = db.GetStop(name);
-  Json::Dict dict;
   if (!stop) {
-    dict["error_message"] = Json::Node("not found"s);
+    WriteNotFound(request_id, writer);
+  } else if (stop->serialized && request_id &&
+             stop->serialized->GetFormat() == writer.GetFormat()) {
+    stop->serialized->Print(*request_id, writer.RawValue());
   } else {
-    vector<Json::Node> bus_nodes;
-    bus_nodes.reserve(stop->bus_names.size());
-    for (const auto& bus_name : stop->bus_names) {
-      bus_nodes.emplace_back(bus_name);
-    }
-    dict["buses"] = Json::Node(move(bus_nodes));
+    stop->Write(writer, request_id);
   }
-  return dict;
 }
 
-Json::Dict Bus::Process(const TransportCatalog& db) const {
+void Bus::Process(const TransportCatalog& db, optional<int> request_id,
+                  Json::Writer& writer) const {
   const auto* bus = db.GetBus(name);
-  Json::Dict dict;
   if (!bus) {
-    dict["error_message"] = Json::Node("not found"s);
+    WriteNotFound(request_id, writer);
+  } else if (bus->serialized && request_id &&
+             bus->serialized->GetFormat() == writer.GetFormat()) {
+    bus->serialized->Print(*request_id, writer.RawValue());
   } else {
-    dict = {
-        {"stop_count", Json::Node(static_cast<int>(bus->stop_count))},
-        {"unique_stop_count",
-         Json::Node(static_cast<int>(bus->unique_stop_count))},
-        {"route_length", Json::Node(bus->road_route_length)},
-        {"curvature",
-         Json::Node(bus->road_route_length / bus->geo_route_length)},
-    };
+    bus->Write(writer, request_id);
   }
-  return dict;
 }
 
-struct RouteItemResponseBuilder {
-  Json::Dict operator()(
-      const TransportRouter::RouteInfo::BusItem& bus_item) const {
-    return Json::Dict{
-        {"type", Json::Node("Bus"s)},
-        {"bus", Json::Node(bus_item.bus_name)},
-        {"time", Json::Node(bus_item.time)},
-        {"span_count", Json::Node(static_cast<int>(bus_item.span_count))}};
+struct RouteItemResponseWriter {
+  Json::Writer& writer;
+
+  void operator()(const TransportRouter::RouteInfo::BusItem& bus_item) const {
+    writer.BeginObject()
+        .Key("bus")
+        .Value(bus_item.bus_name)
+        .Key("span_count")
+        .Value(static_cast<int>(bus_item.span_count))
+        .Key("time")
+        .Value(bus_item.time)
+        .Key("type")
+        .Value("Bus")
+        .EndObject();
   }
-  Json::Dict operator()(
+  void operator()(
       const TransportRouter::RouteInfo::WaitItem& wait_item) const {
-    return Json::Dict{
-        {"type", Json::Node("Wait"s)},
-        {"stop_name", Json::Node(wait_item.stop_name)},
-        {"time", Json::Node(wait_item.time)},
-    };
+    writer.BeginObject()
+        .Key("stop_name")
+        .Value(wait_item.stop_name)
+        .Key("time")
+        .Value(wait_item.time)
+        .Key("type")
+        .Value("Wait")
+        .EndObject();
   }
 };
 
-Json::Dict Route::Process(const TransportCatalog& db) const {
-  Json::Dict dict;
+void Route::Process(const TransportCatalog& db, optional<int> request_id,
+                    Json::Writer& writer) const {
   const auto route = db.FindRoute(stop_from, stop_to);
   if (!route) {
-    dict["error_message"] = Json::Node("not found"s);
-  } else {
-    dict["total_time"] = Json::Node(route->total_time);
-    vector<Json::Node> items;
-    items.reserve(route->items.size());
-    for (const auto& item : route->items) {
-      items.push_back(visit(RouteItemResponseBuilder{}, item));
-    }
+    WriteNotFound(request_id, writer);
+    return;
+  }
+  writer.BeginObject().Key("items").BeginArray();
+  for (const auto& item : route->items) {
+    visit(RouteItemResponseWriter{writer}, item);
+  }
+  writer.EndArray();
+  Responses::WriteRequestId(writer, request_id);
+  writer.Key("total_time").Value(route->total_time).EndObject();
+}
+
+void Map::Process(const TransportCatalog& db, optional<int> request_id,
+                  Json::Writer& writer) const {
+  writer.BeginObject().Key("map").Value(db.RenderMap());
+  Responses::WriteRequestId(writer, request_id);
+  writer.EndObject();
+}
+
+namespace {
 
-    dict["items"] = move(items);
+void WriteStopsResponse(const vector<SpatialIndex::Neighbour>& neighbours,
+                        optional<int> request_id, Json::Writer& writer) {
+  writer.BeginObject();
+  Responses::WriteRequestId(writer, request_id);
+  writer.Key("stops").BeginArray();
+  for (const auto& neighbour : neighbours) {
+    writer.BeginObject()
+        .Key("distance")
+        .Value(neighbour.distance)
+        .Key("name")
+        .Value(*neighbour.stop_name)
+        .EndObject();
   }
+  writer.EndArray().EndObject();
+}
+
+Sphere::Point ReadPosition(const Json::Dict& attrs) {
+  return {
+      .latitude = attrs.at("latitude").AsDouble(),
+      .longitude = attrs.at("longitude").AsDouble(),
+  };
+}
+
+}  // namespace
+
+void NearestStops::Process(const TransportCatalog& db,
+                           optional<int> request_id,
+                           Json::Writer& writer) const {
+  WriteStopsResponse(db.FindNearestStops(position, count), request_id, writer);
+}
 
-  return dict;
+void StopsInRadius::Process(const TransportCatalog& db,
+                            optional<int> request_id,
+                            Json::Writer& writer) const {
+  WriteStopsResponse(db.FindStopsInRadius(position, radius), request_id,
+                     writer);
 }
 
 Request Read(const Json::Dict& attrs) {
@@ -94,25 +169,444 @@ Request Read(const Json::Dict& attrs) {
   if (type == "Map") {
     return Map{};
   }
+  if (type == "NearestStops") {
+    const int count = attrs.at("count").AsInt();
+    if (count < 0) {
+      throw invalid_argument("negative count of NearestStops");
+    }
+    return NearestStops{ReadPosition(attrs), static_cast<size_t>(count)};
+  }
+  if (type == "StopsInRadius") {
+    return StopsInRadius{ReadPosition(attrs), attrs.at("radius").AsDouble()};
+  }
   throw invalid_argument("unknown request type: " + type);
 }
 
-vector<Json::Node> ProcessAll(const TransportCatalog& db,
-                              const vector<Json::Node>& requests) {
-  vector<Json::Node> responses;
-  responses.reserve(requests.size());
-  for (const Json::Node& request_node : requests) {
-    Json::Dict dict =
-        visit([&db](const auto& request) { return request.Process(db); },
-              Requests::Read(request_node.AsMap()));
-    dict["request_id"] = Json::Node(request_node.AsMap().at("id").AsInt());
-    responses.push_back(Json::Node(dict));
+namespace {
+
+const size_t kRequestsChunkSize = 64;
+const size_t kPipelineQueueSize = 256;
+// of ReadWorkerCount, per hardware thread
+const int64_t kMaxWorkersPerThread = 4;
+
+const string_view kRequestKeys[] = {
+    "id",       "type",      "name",  "from",  "to",
+    "latitude", "longitude", "count", "radius"};
+
+// Builds the dict of ParseRequest
+class RequestHandler : public Json::Handler {
+ public:
+  void OnStartObject() {
+    is_object_ = is_object_ || depth_ == 0;
+    ++depth_;
+  }
+  void OnEndObject() { --depth_; }
+  void OnStartArray() { ++depth_; }
+  void OnEndArray() { --depth_; }
+
+  void OnKey(string_view key) {
+    if (depth_ != 1) {
+      return;
+    }
+    const auto it = find(begin(kRequestKeys), end(kRequestKeys), key);
+    key_ = it != end(kRequestKeys) ? *it : string_view();
+  }
+
+  void OnString(string_view value) { Add(Json::Node(string(value))); }
+  void OnNumber(Json::Number value) {
+    Add(visit([](auto number) { return Json::Node(number); }, value));
+  }
+  void OnBool(bool value) { Add(Json::Node(value)); }
+  void OnNull() {
+    if (IsKept()) {
+      throw invalid_argument("null values are not supported");
+    }
+  }
+
+  Json::Dict GetResult() {
+    if (!is_object_) {
+      throw invalid_argument("request is not a JSON object");
+    }
+    return move(result_);
+  }
+
+ private:
+  bool IsKept() const { return is_object_ && depth_ == 1 && !key_.empty(); }
+
+  void Add(Json::Node value) {
+    if (IsKept()) {
+      result_.emplace(key_, move(value));
+    }
+  }
+
+  int depth_ = 0;
+  bool is_object_ = false;
+  string_view key_;  // of kRequestKeys, empty for the others
+  Json::Dict result_;
+};
+
+void Process(const TransportCatalog& db, const Json::Dict& request_json,
+             optional<int> request_id, Json::Writer& writer) {
+  visit(
+      [&](const auto& request) { request.Process(db, request_id, writer); },
+      Read(request_json));
+}
+
+// Equal for requests equal up to id.
+// Doubles are printed in full, so that positions a few meters apart
+// are different requests
+string MakeCanonicalKey(const Json::Dict& request_json) {
+  OutputBuffer key;
+  key.SetPrecision(numeric_limits<double>::max_digits10);
+  for (const auto& [name, value] : request_json) {
+    if (name != "id") {
+      key << name.str() << '\0';
+      Json::PrintNode(value, key);
+      key << '\0';
+    }
   }
-  return responses;
+  return key.Take();
 }
 
-Json::Dict Map::Process(const TransportCatalog& db) const {
-  return Json::Dict{{"map", db.RenderMap()}};
+// Requests of a batch that occur more than once, each printed once
+// with a gap for the request id
+class DuplicateResponses {
+ public:
+  DuplicateResponses(const vector<Json::Node>& requests, Json::Format format);
+
+  void Build(const TransportCatalog& db, size_t begin, size_t end);
+  size_t GetCount() const { return requests_.size(); }
+
+  // nullptr for requests that occur once
+  const Json::Template* Find(size_t request_idx) const;
+
+ private:
+  static constexpr size_t kNone = numeric_limits<size_t>::max();
+
+  Json::Format format_;
+  vector<const Json::Dict*> requests_;
+  vector<optional<Json::Template>> templates_;
+  // by the index in the batch
+  vector<size_t> template_idxs_;
+};
+
+DuplicateResponses::DuplicateResponses(const vector<Json::Node>& requests,
+                                       Json::Format format)
+    : format_(format), template_idxs_(requests.size(), kNone) {
+  vector<string> keys;
+  keys.reserve(requests.size());
+  unordered_map<string_view, size_t> key_counts;
+  for (const auto& request_node : requests) {
+    keys.push_back(MakeCanonicalKey(request_node.AsMap()));
+    ++key_counts[keys.back()];
+  }
+
+  unordered_map<string_view, size_t> template_idxs;
+  for (size_t i = 0; i < requests.size(); ++i) {
+    if (key_counts[keys[i]] == 1) {
+      continue;
+    }
+    const auto [it, inserted] =
+        template_idxs.emplace(keys[i], requests_.size());
+    if (inserted) {
+      requests_.push_back(&requests[i].AsMap());
+    }
+    template_idxs_[i] = it->second;
+  }
+  templates_.resize(requests_.size());
+}
+
+void DuplicateResponses::Build(const TransportCatalog& db, size_t begin,
+                               size_t end) {
+  for (size_t i = begin; i < end; ++i) {
+    templates_[i].emplace(
+        [&](Json::Writer& writer) {
+          Process(db, *requests_[i], nullopt, writer);
+        },
+        format_);
+  }
+}
+
+const Json::Template* DuplicateResponses::Find(size_t request_idx) const {
+  const size_t template_idx = template_idxs_[request_idx];
+  return template_idx == kNone ? nullptr : &*templates_[template_idx];
+}
+
+void WriteResponse(const TransportCatalog& db, const Json::Dict& request_json,
+                   const Json::Template* duplicate, Json::Writer& writer) {
+  const auto start = Profile::IsEnabled() ? Profile::Clock::now()
+                                          : Profile::Clock::time_point{};
+  const int request_id = request_json.at("id").AsInt();
+  if (duplicate) {
+    duplicate->Print(request_id, writer.RawValue());
+  } else {
+    Process(db, request_json, request_id, writer);
+  }
+  if (Profile::IsEnabled()) {
+    const auto duration = Profile::Clock::now() - start;
+    Profile::GetRequestHistogram(request_json.at("type").AsString())
+        .Record(chrono::nanoseconds(duration).count());
+  }
+}
+
+// Remembers requests of a stream, so that the ones seen more than once
+// are processed once more at most, as DuplicateResponses does for a batch
+class ResponseCache {
+ public:
+  // The key is that of MakeCanonicalKey
+  void WriteResponse(const TransportCatalog& db, string key,
+                     const Json::Dict& request_json, Json::Writer& writer);
+
+ private:
+  static const size_t kMaxSize = 1 << 16;
+
+  // nullopt for requests seen once so far
+  unordered_map<string, optional<Json::Template>> responses_;
+};
+
+void ResponseCache::WriteResponse(const TransportCatalog& db, string key,
+                                  const Json::Dict& request_json,
+                                  Json::Writer& writer) {
+  if (responses_.size() >= kMaxSize) {
+    responses_.clear();
+  }
+  auto [it, inserted] = responses_.try_emplace(move(key));
+  auto& response = it->second;
+  if (!inserted && !response) {
+    response.emplace([&](Json::Writer& writer) {
+      Process(db, request_json, nullopt, writer);
+    });
+  }
+  Requests::WriteResponse(db, request_json, response ? &*response : nullptr,
+                          writer);
+}
+
+}  // namespace
+
+Json::Dict ParseRequest(string_view input) {
+  RequestHandler handler;
+  Json::Parse(input, handler);
+  return handler.GetResult();
+}
+
+void Process(const TransportCatalog& db, const Json::Dict& request_json,
+             Json::Writer& writer) {
+  WriteResponse(db, request_json, nullptr, writer);
+}
+
+void ProcessAll(const TransportCatalog& db,
+                const vector<Json::Node>& requests, OutputBuffer& output,
+                size_t worker_count, Json::Format format) {
+  DuplicateResponses duplicates(requests, format);
+  Json::Writer writer(output, format);
+  writer.BeginArray();
+  if (worker_count <= 1) {
+    duplicates.Build(db, 0, duplicates.GetCount());
+    for (size_t i = 0; i < requests.size(); ++i) {
+      WriteResponse(db, requests[i].AsMap(), duplicates.Find(i), writer);
+    }
+    writer.EndArray();
+    return;
+  }
+
+  ThreadPool pool(worker_count);
+  // a single Map or Route may be heavy, so they are handed out one by one
+  ParallelForDynamic(pool, duplicates.GetCount(), 1,
+                     [&](size_t begin, size_t end) {
+                       duplicates.Build(db, begin, end);
+                     });
+
+  // every response has its own slot, so workers never wait for each other
+  vector<string> responses(requests.size());
+  ParallelForDynamic(
+      pool, requests.size(), kRequestsChunkSize,
+      [&](size_t begin, size_t end) {
+        OutputBuffer response;
+        for (size_t i = begin; i < end; ++i) {
+          Json::Writer response_writer(response, format);
+          WriteResponse(db, requests[i].AsMap(), duplicates.Find(i),
+                        response_writer);
+          responses[i] = response.Take();
+        }
+      });
+
+  for (const string& response : responses) {
+    writer.RawValue() << response;
+  }
+  writer.EndArray();
+}
+
+void ProcessStream(const TransportCatalog& db, istream& input,
+                   OutputBuffer& output, size_t worker_count) {
+  Json::Writer writer(output);
+  writer.BeginArray();
+  if (worker_count <= 1) {
+    ResponseCache cache;
+    Json::ForEachElement(input, [&](istream& input) {
+      const Json::Node request = Json::LoadNode(input);
+      cache.WriteResponse(db, MakeCanonicalKey(request.AsMap()),
+                          request.AsMap(), writer);
+    });
+    writer.EndArray();
+    return;
+  }
+
+  // Requests go to the workers by their keys, so that every duplicate
+  // of a request finds the response in the cache of the same worker.
+  // The writer takes the responses in the order of the workers
+  // the requests went to. Each queue has a single producer and
+  // a single consumer, nullopt ends the stream
+  struct Request {
+    string key;
+    Json::Node node;
+  };
+  struct Worker {
+    SpscQueue<optional<Request>> requests{kPipelineQueueSize};
+    SpscQueue<string> responses{kPipelineQueueSize};
+    ResponseCache cache;
+  };
+  vector<unique_ptr<Worker>> workers;
+  for (size_t i = 0; i < worker_count; ++i) {
+    workers.push_back(make_unique<Worker>());
+  }
+  SpscQueue<optional<size_t>> worker_idxs(kPipelineQueueSize * worker_count);
+
+  // a failed stage stops the others instead of leaving them waiting
+  const auto cancel = [&] {
+    for (const auto& worker : workers) {
+      worker->requests.Close();
+      worker->responses.Close();
+    }
+    worker_idxs.Close();
+  };
+  const auto cancel_on_error = [&cancel](auto stage) {
+    return [&cancel, stage] {
+      try {
+        stage();
+      } catch (...) {
+        cancel();
+        throw;
+      }
+    };
+  };
+
+  // Stages wait for each other, so the pool has a thread for every one
+  // of them; the calling thread reads requests
+  ThreadPool pool(worker_count + 1);
+  vector<future<void>> futures;
+  for (const auto& worker : workers) {
+    futures.push_back(pool.Submit(cancel_on_error([&, &worker = *worker] {
+      OutputBuffer response_output;
+      optional<Request> request;
+      while (worker.requests.Pop(request) && request) {
+        Json::Writer response_writer(response_output);
+        worker.cache.WriteResponse(db, move(request->key),
+                                   request->node.AsMap(), response_writer);
+        string response = response_output.Take();
+        if (!worker.responses.Push(response)) {
+          return;
+        }
+      }
+    })));
+  }
+  futures.push_back(pool.Submit(cancel_on_error([&] {
+    optional<size_t> worker_idx;
+    string response;
+    while (worker_idxs.Pop(worker_idx) && worker_idx &&
+           workers[*worker_idx]->responses.Pop(response)) {
+      writer.RawValue() << response;
+    }
+  })));
+
+  exception_ptr read_error;
+  try {
+    const auto push = [](auto& queue, auto value) {
+      if (!queue.Push(value)) {
+        throw runtime_error("request pipeline is cancelled");
+      }
+    };
+    Json::ForEachElement(input, [&](istream& input) {
+      Json::Node node = Json::LoadNode(input);
+      string key = MakeCanonicalKey(node.AsMap());
+      const size_t worker_idx = hash<string>{}(key) % workers.size();
+      push(workers[worker_idx]->requests,
+           optional<Request>(Request{move(key), move(node)}));
+      push(worker_idxs, optional<size_t>(worker_idx));
+    });
+    for (const auto& worker : workers) {
+      push(worker->requests, optional<Request>());
+    }
+    push(worker_idxs, optional<size_t>());
+  } catch (...) {
+    read_error = current_exception();
+    cancel();
+  }
+  WaitAll(futures);
+  if (read_error) {
+    rethrow_exception(read_error);
+  }
+  writer.EndArray();
+}
+
+void ProcessInput(istream& input, OutputBuffer& output) {
+  vector<Descriptions::InputQuery> descriptions;
+  bool has_descriptions = false;
+  Json::Dict input_map;
+  unique_ptr<const TransportCatalog> db;
+  const auto build_catalog = [&] {
+    const Json::Dict serving_settings = GetServingSettings(input_map);
+    ThreadPool pool(ReadWorkerCount(serving_settings));
+    db = make_unique<const TransportCatalog>(
+        move(descriptions), input_map.at("routing_settings").AsMap(),
+        input_map.at("render_settings").AsMap(), serving_settings, pool);
+  };
+  Json::ForEachField(input, [&](const string& key, istream& input) {
+    if (key == "base_requests") {
+      Profile::PhaseTimer timer("describe");
+      descriptions = Descriptions::ReadDescriptions(input);
+      has_descriptions = true;
+    } else if (key == "stat_requests" && has_descriptions &&
+               input_map.count("routing_settings") > 0 &&
+               input_map.count("render_settings") > 0) {
+      build_catalog();
+      Profile::PhaseTimer timer("respond");
+      ProcessStream(*db, input, output,
+                    ReadWorkerCount(GetServingSettings(input_map)));
+    } else {
+      Profile::PhaseTimer timer("parse");
+      input_map.emplace(key, Json::LoadNode(input));
+    }
+  });
+
+  if (!db) {
+    build_catalog();
+    Profile::PhaseTimer timer("respond");
+    ProcessAll(*db, input_map.at("stat_requests").AsArray(), output,
+               ReadWorkerCount(GetServingSettings(input_map)));
+  }
+}
+
+Json::Dict GetServingSettings(const Json::Dict& input_map) {
+  const auto it = input_map.find("serving_settings");
+  return it != input_map.end() ? it->second.AsMap() : Json::Dict{};
+}
+
+size_t ReadWorkerCount(const Json::Dict& serving_settings_json) {
+  const size_t default_count = ThreadPool::GetDefaultThreadCount();
+  int64_t count = default_count;
+  if (serving_settings_json.count("workers") > 0) {
+    count = serving_settings_json.at("workers").AsInt64();
+  } else if (const char* workers = getenv("TRANSPORT_CATALOG_WORKERS")) {
+    // not a number: the default is kept
+    const char* const end = workers + strlen(workers);
+    if (const auto result = from_chars(workers, end, count);
+        result.ec != errc{} || result.ptr != end) {
+      count = default_count;
+    }
+  }
+  const int64_t max_count =
+      kMaxWorkersPerThread * static_cast<int64_t>(default_count);
+  return clamp<int64_t>(count, 1, max_count);
 }
 
 }  // namespace Requests
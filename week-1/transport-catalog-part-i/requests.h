@@ -1,41 +1,114 @@
 #pragma once
 
+#include <iostream>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <variant>
 
 #include "json.h"
+#include "output_buffer.h"
 #include "renderer.h"
+#include "sphere.h"
 #include "transport_catalog.h"
 
 namespace Requests {
 
+// Process of every request type leaves a gap for the id without one,
+// see Json::Template
+
 struct Stop {
   std::string name;
 
-  Json::Dict Process(const TransportCatalog& db) const;
+  void Process(const TransportCatalog& db, std::optional<int> request_id,
+               Json::Writer& writer) const;
 };
 
 struct Bus {
   std::string name;
 
-  Json::Dict Process(const TransportCatalog& db) const;
+  void Process(const TransportCatalog& db, std::optional<int> request_id,
+               Json::Writer& writer) const;
 };
 
 struct Route {
   std::string stop_from;
   std::string stop_to;
 
-  Json::Dict Process(const TransportCatalog& db) const;
+  void Process(const TransportCatalog& db, std::optional<int> request_id,
+               Json::Writer& writer) const;
 };
 
 struct Map {
-  Json::Dict Process(const TransportCatalog& db) const;
+  void Process(const TransportCatalog& db, std::optional<int> request_id,
+               Json::Writer& writer) const;
+};
+
+struct NearestStops {
+  Sphere::Point position;
+  size_t count;
+
+  void Process(const TransportCatalog& db, std::optional<int> request_id,
+               Json::Writer& writer) const;
+};
+
+struct StopsInRadius {
+  Sphere::Point position;
+  double radius;  // in metres
+
+  void Process(const TransportCatalog& db, std::optional<int> request_id,
+               Json::Writer& writer) const;
 };
 
-using Request = std::variant<Stop, Bus, Route, Map>;
+using Request =
+    std::variant<Stop, Bus, Route, Map, NearestStops, StopsInRadius>;
 
 Request Read(const Json::Dict& attrs);
 
-std::vector<Json::Node> ProcessAll(const TransportCatalog& db,
-                                   const std::vector<Json::Node>& requests);
+// Request object of a line of untrusted input, for long-lived processes:
+// only top-level fields under the keys of requests are kept, so that
+// clients cannot grow the table of interned keys with keys of their own.
+// Throws std::invalid_argument for input other than an object
+Json::Dict ParseRequest(std::string_view input);
+
+// Request of the "id" and "type" keys and the attributes of its type.
+// Recorded in the request histograms when profiling
+void Process(const TransportCatalog& db, const Json::Dict& request_json,
+             Json::Writer& writer);
+
+// Prints responses as soon as they are ready, without building nodes
+// for them, splicing request ids into responses precomputed by the catalog
+// whenever there are some.
+// Requests equal up to id are processed once per batch.
+// With several workers requests are processed concurrently,
+// since they only read the catalog, and printed in their original order.
+// The catalog precomputes JSON responses only, CBOR ones are written anew
+void ProcessAll(const TransportCatalog& db,
+                const std::vector<Json::Node>& requests, OutputBuffer& output,
+                size_t worker_count = 1,
+                Json::Format format = Json::Format::JSON);
+
+// Pipelined ProcessAll for a stat_requests array still in the input:
+// requests are processed while the rest is read and printed while
+// the rest is processed, and memory is bounded by the queues between
+// these stages rather than by the batch.
+// Requests seen more than once are processed once per worker.
+void ProcessStream(const TransportCatalog& db, std::istream& input,
+                   OutputBuffer& output, size_t worker_count = 1);
+
+// Whole input of the program, read as a stream: base_requests goes
+// straight into descriptions, while the rest is small enough to be kept
+// as nodes. stat_requests is processed while being read, see
+// ProcessStream, if everything needed for the catalog comes before it,
+// as it usually does, and with ProcessAll once the input is read otherwise
+void ProcessInput(std::istream& input, OutputBuffer& output);
+
+// serving_settings of the input, empty if there are none
+Json::Dict GetServingSettings(const Json::Dict& input_map);
+
+// serving_settings.workers of the input, TRANSPORT_CATALOG_WORKERS
+// of the environment or every hardware thread, in that order.
+// Kept between 1 and 4 per hardware thread, a variable that is not
+// a number is ignored
+size_t ReadWorkerCount(const Json::Dict& serving_settings_json);
 }  // namespace Requests
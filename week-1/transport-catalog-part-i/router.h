@@ -4,6 +4,7 @@
 #include <cassert>
 #include <cstdint>
 #include <iterator>
+#include <mutex>
 #include <optional>
 #include <unordered_map>
 #include <utility>
@@ -33,6 +34,16 @@ class Router {
   EdgeId GetRouteEdge(RouteId route_id, size_t edge_idx) const;
   void ReleaseRoute(RouteId route_id);
 
+  struct ExpandedRouteInfo {
+    Weight weight;
+    std::vector<EdgeId> edges;
+  };
+
+  // The edges right away, without the shared cache of BuildRoute,
+  // so that concurrent callers never wait for each other
+  std::optional<ExpandedRouteInfo> BuildExpandedRoute(VertexId from,
+                                                      VertexId to) const;
+
  private:
   const Graph& graph_;
 
@@ -44,6 +55,8 @@ class Router {
       std::vector<std::vector<std::optional<RouteInternalData>>>;
 
   using ExpandedRoute = std::vector<EdgeId>;
+  // routes may be built concurrently, everything else is read-only
+  mutable std::mutex expanded_routes_mutex_;
   mutable RouteId next_route_id_ = 0;
   mutable std::unordered_map<RouteId, ExpandedRoute> expanded_routes_cache_;
 
@@ -111,11 +124,24 @@ Router<Weight>::Router(const Graph& graph)
 template <typename Weight>
 std::optional<typename Router<Weight>::RouteInfo> Router<Weight>::BuildRoute(
     VertexId from, VertexId to) const {
+  auto route = BuildExpandedRoute(from, to);
+  if (!route) {
+    return std::nullopt;
+  }
+  const size_t route_edge_count = route->edges.size();
+  std::lock_guard lock(expanded_routes_mutex_);
+  const RouteId route_id = next_route_id_++;
+  expanded_routes_cache_[route_id] = std::move(route->edges);
+  return RouteInfo{route_id, route->weight, route_edge_count};
+}
+
+template <typename Weight>
+std::optional<typename Router<Weight>::ExpandedRouteInfo>
+Router<Weight>::BuildExpandedRoute(VertexId from, VertexId to) const {
   const auto& route_internal_data = routes_internal_data_[from][to];
   if (!route_internal_data) {
     return std::nullopt;
   }
-  const Weight weight = route_internal_data->weight;
   std::vector<EdgeId> edges;
   for (std::optional<EdgeId> edge_id = route_internal_data->prev_edge; edge_id;
        edge_id = routes_internal_data_[from][graph_.GetEdge(*edge_id).from]
@@ -123,20 +149,18 @@ std::optional<typename Router<Weight>::RouteInfo> Router<Weight>::BuildRoute(
     edges.push_back(*edge_id);
   }
   std::reverse(std::begin(edges), std::end(edges));
-
-  const RouteId route_id = next_route_id_++;
-  const size_t route_edge_count = edges.size();
-  expanded_routes_cache_[route_id] = std::move(edges);
-  return RouteInfo{route_id, weight, route_edge_count};
+  return ExpandedRouteInfo{route_internal_data->weight, std::move(edges)};
 }
 
 template <typename Weight>
 EdgeId Router<Weight>::GetRouteEdge(RouteId route_id, size_t edge_idx) const {
+  std::lock_guard lock(expanded_routes_mutex_);
   return expanded_routes_cache_.at(route_id)[edge_idx];
 }
 
 template <typename Weight>
 void Router<Weight>::ReleaseRoute(RouteId route_id) {
+  std::lock_guard lock(expanded_routes_mutex_);
   expanded_routes_cache_.erase(route_id);
 }
 
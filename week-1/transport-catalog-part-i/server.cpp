@@ -0,0 +1,222 @@
+#include "server.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <csignal>
+#include <condition_variable>
+#include <cstring>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
+#include <streambuf>
+#include <system_error>
+#include <thread>
+
+#include "json.h"
+#include "output_buffer.h"
+#include "requests.h"
+
+using namespace std;
+
+namespace {
+
+const size_t kMaxPendingPerWorker = 64;
+
+// Buffered stream over a file descriptor, for one direction only
+class FdStreamBuf : public streambuf {
+ public:
+  explicit FdStreamBuf(int fd) : fd_(fd) {
+    setg(buffer_, buffer_, buffer_);
+    setp(buffer_, buffer_ + sizeof(buffer_));
+  }
+
+  ~FdStreamBuf() override { sync(); }
+
+ protected:
+  int_type underflow() override {
+    ssize_t size;
+    do {
+      size = read(fd_, buffer_, sizeof(buffer_));
+    } while (size < 0 && errno == EINTR);
+    if (size <= 0) {
+      return traits_type::eof();
+    }
+    setg(buffer_, buffer_, buffer_ + size);
+    return traits_type::to_int_type(buffer_[0]);
+  }
+
+  int_type overflow(int_type c) override {
+    if (sync() != 0) {
+      return traits_type::eof();
+    }
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+      *pptr() = traits_type::to_char_type(c);
+      pbump(1);
+    }
+    return traits_type::not_eof(c);
+  }
+
+  int sync() override {
+    for (const char* begin = pbase(); begin < pptr();) {
+      const ssize_t size = write(fd_, begin, pptr() - begin);
+      if (size < 0 && errno != EINTR) {
+        return -1;
+      }
+      begin += max<ssize_t>(size, 0);
+    }
+    setp(buffer_, buffer_ + sizeof(buffer_));
+    return 0;
+  }
+
+ private:
+  int fd_;
+  char buffer_[1 << 16];
+};
+
+}  // namespace
+
+RequestServer::RequestServer(const CatalogHolder& catalog, size_t worker_count)
+    : catalog_(catalog),
+      pool_(worker_count),
+      max_pending_count_(kMaxPendingPerWorker * pool_.GetThreadCount()) {}
+
+void RequestServer::Serve(istream& input, ostream& output) {
+  // Responses are printed by a thread of their own: a client waiting
+  // for a response before sending more requests must get it right away
+  mutex queue_mutex;
+  condition_variable queue_cv;
+  queue<future<string>> responses;
+  bool is_input_over = false;
+
+  thread printer([&] {
+    while (true) {
+      future<string> response;
+      {
+        unique_lock lock(queue_mutex);
+        queue_cv.wait(lock,
+                      [&] { return !responses.empty() || is_input_over; });
+        if (responses.empty()) {
+          return;
+        }
+        response = move(responses.front());
+        responses.pop();
+      }
+      queue_cv.notify_all();
+
+      output << response.get() << '\n';
+      unique_lock lock(queue_mutex);
+      if (responses.empty()) {
+        output.flush();
+      }
+    }
+  });
+
+  for (string line; getline(input, line);) {
+    if (line.find_first_not_of(" \t\r") == string::npos) {
+      continue;
+    }
+    auto response =
+        pool_.Submit([this, line = move(line)] { return Respond(line); });
+    unique_lock lock(queue_mutex);
+    queue_cv.wait(lock,
+                  [&] { return responses.size() < max_pending_count_; });
+    responses.push(move(response));
+    queue_cv.notify_all();
+  }
+
+  {
+    lock_guard lock(queue_mutex);
+    is_input_over = true;
+  }
+  queue_cv.notify_all();
+  printer.join();
+  output.flush();
+}
+
+void RequestServer::ServeUnixSocket(const string& path) {
+  // a client leaving early must not kill the whole process
+  signal(SIGPIPE, SIG_IGN);
+
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path)) {
+    throw invalid_argument("socket path is too long: " + path);
+  }
+  strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+  const int server_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (server_fd < 0) {
+    throw system_error(errno, generic_category(), "socket");
+  }
+  unlink(path.c_str());
+  if (bind(server_fd, reinterpret_cast<const sockaddr*>(&address),
+           sizeof(address)) < 0 ||
+      listen(server_fd, SOMAXCONN) < 0) {
+    const int error = errno;
+    close(server_fd);
+    throw system_error(error, generic_category(), "bind " + path);
+  }
+
+  // Clients are detached, so that the threads of finished ones are freed
+  // in a long-lived process; the ones left are waited for on return
+  mutex clients_mutex;
+  condition_variable clients_cv;
+  size_t client_count = 0;
+  while (true) {
+    const int client_fd = accept(server_fd, nullptr, nullptr);
+    if (client_fd < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    {
+      lock_guard lock(clients_mutex);
+      ++client_count;
+    }
+    try {
+      thread([&, client_fd] {
+        {
+          FdStreamBuf input_buffer(client_fd);
+          FdStreamBuf output_buffer(client_fd);
+          istream input(&input_buffer);
+          ostream output(&output_buffer);
+          Serve(input, output);
+        }
+        close(client_fd);
+        // under the lock, so that the server outlives the notification
+        lock_guard lock(clients_mutex);
+        --client_count;
+        clients_cv.notify_all();
+      }).detach();
+    } catch (const system_error&) {
+      // out of threads: the client is dropped, the server goes on
+      close(client_fd);
+      lock_guard lock(clients_mutex);
+      --client_count;
+    }
+  }
+
+  close(server_fd);
+  unique_lock lock(clients_mutex);
+  clients_cv.wait(lock, [&] { return client_count == 0; });
+}
+
+string RequestServer::Respond(const string& line) const {
+  OutputBuffer output;
+  try {
+    const Json::Dict request = Requests::ParseRequest(line);
+    Json::Writer writer(output);
+    Requests::Process(*catalog_.Acquire(), request, writer);
+  } catch (const exception& e) {
+    // a bad request must not take down the others
+    output.Clear();
+    Json::Writer writer(output);
+    writer.BeginObject().Key("error_message").Value(e.what()).EndObject();
+  }
+  return output.Take();
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+
+#include "catalog_holder.h"
+#include "thread_pool.h"
+
+// Serves stat requests of a long-lived process, so that the catalog
+// is built once for all of them.
+// Requests come as newline-delimited JSON, one request object per line,
+// and each response is printed on a line of its own in the request order.
+// Requests are pipelined: a client may send more before reading responses.
+class RequestServer {
+ public:
+  RequestServer(const CatalogHolder& catalog, size_t worker_count);
+
+  // Until the end of input
+  void Serve(std::istream& input, std::ostream& output);
+
+  // Every client of the socket is served as a stream of its own,
+  // until the socket fails
+  void ServeUnixSocket(const std::string& path);
+
+ private:
+  std::string Respond(const std::string& line) const;
+
+  const CatalogHolder& catalog_;
+  ThreadPool pool_;
+  // requests read ahead of the printed responses
+  size_t max_pending_count_;
+};
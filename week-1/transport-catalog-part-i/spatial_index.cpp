@@ -0,0 +1,177 @@
+#include "spatial_index.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace {
+
+double ComputeChordSq(const double* lhs, const double* rhs) {
+  double result = 0;
+  for (size_t axis = 0; axis < 3; ++axis) {
+    const double diff = lhs[axis] - rhs[axis];
+    result += diff * diff;
+  }
+  return result;
+}
+
+}  // namespace
+
+SpatialIndex::Vector SpatialIndex::Vector::FromPosition(
+    Sphere::Point position) {
+  const auto radians = Sphere::Point::FromDegrees(position.latitude,
+                                                  position.longitude);
+  return {{
+      cos(radians.latitude) * cos(radians.longitude),
+      cos(radians.latitude) * sin(radians.longitude),
+      sin(radians.latitude),
+  }};
+}
+
+SpatialIndex::SpatialIndex(const Descriptions::StopsDict& stops_dict) {
+  stop_names_.reserve(stops_dict.size());
+  nodes_.reserve(stops_dict.size());
+  for (const auto& [stop_name, stop] : stops_dict) {
+    nodes_.push_back({.point = Vector::FromPosition(stop->position),
+                      .stop_idx = static_cast<uint32_t>(stop_names_.size()),
+                      .split_axis = 0});
+    stop_names_.push_back(stop_name);
+  }
+  Build(0, nodes_.size());
+}
+
+void SpatialIndex::Build(size_t begin, size_t end) {
+  if (end - begin <= 1) {
+    return;
+  }
+
+  uint8_t split_axis = 0;
+  double max_extent = -1;
+  for (uint8_t axis = 0; axis < 3; ++axis) {
+    const auto [min_it, max_it] = minmax_element(
+        nodes_.begin() + begin, nodes_.begin() + end,
+        [axis](const Node& lhs, const Node& rhs) {
+          return lhs.point.coords[axis] < rhs.point.coords[axis];
+        });
+    if (const double extent =
+            max_it->point.coords[axis] - min_it->point.coords[axis];
+        extent > max_extent) {
+      max_extent = extent;
+      split_axis = axis;
+    }
+  }
+
+  const size_t mid = begin + (end - begin) / 2;
+  nth_element(nodes_.begin() + begin, nodes_.begin() + mid,
+              nodes_.begin() + end,
+              [split_axis](const Node& lhs, const Node& rhs) {
+                return lhs.point.coords[split_axis] <
+                       rhs.point.coords[split_axis];
+              });
+  nodes_[mid].split_axis = split_axis;
+
+  Build(begin, mid);
+  Build(mid + 1, end);
+}
+
+vector<SpatialIndex::Neighbour> SpatialIndex::FindNearest(
+    Sphere::Point position, size_t count) const {
+  vector<Candidate> heap;
+  if (count > 0) {
+    heap.reserve(min(count, nodes_.size()));
+    SearchNearest(0, nodes_.size(), Vector::FromPosition(position), count,
+                  heap);
+  }
+  return MakeNeighbours(move(heap));
+}
+
+void SpatialIndex::SearchNearest(size_t begin, size_t end,
+                                 const Vector& target, size_t count,
+                                 vector<Candidate>& heap) const {
+  if (begin >= end) {
+    return;
+  }
+  const size_t mid = begin + (end - begin) / 2;
+  const Node& node = nodes_[mid];
+
+  const Candidate candidate{ComputeChordSq(node.point.coords, target.coords),
+                            node.stop_idx};
+  if (heap.size() < count) {
+    heap.push_back(candidate);
+    push_heap(heap.begin(), heap.end());
+  } else if (candidate < heap.front()) {
+    pop_heap(heap.begin(), heap.end());
+    heap.back() = candidate;
+    push_heap(heap.begin(), heap.end());
+  }
+
+  const double diff =
+      target.coords[node.split_axis] - node.point.coords[node.split_axis];
+  if (diff < 0) {
+    SearchNearest(begin, mid, target, count, heap);
+  } else {
+    SearchNearest(mid + 1, end, target, count, heap);
+  }
+  if (heap.size() < count || diff * diff < heap.front().chord_sq) {
+    if (diff < 0) {
+      SearchNearest(mid + 1, end, target, count, heap);
+    } else {
+      SearchNearest(begin, mid, target, count, heap);
+    }
+  }
+}
+
+vector<SpatialIndex::Neighbour> SpatialIndex::FindInRadius(
+    Sphere::Point position, double radius) const {
+  // chord = 2 * sin(angle / 2), the whole sphere lies within chord 2
+  const double half_angle = radius / Sphere::EARTH_RADIUS / 2;
+  const double max_chord =
+      half_angle >= Sphere::PI / 2 ? 2.0 : 2 * sin(half_angle);
+
+  vector<Candidate> found;
+  if (radius >= 0) {
+    SearchInRadius(0, nodes_.size(), Vector::FromPosition(position),
+                   max_chord * max_chord, found);
+  }
+  return MakeNeighbours(move(found));
+}
+
+void SpatialIndex::SearchInRadius(size_t begin, size_t end,
+                                  const Vector& target, double max_chord_sq,
+                                  vector<Candidate>& found) const {
+  if (begin >= end) {
+    return;
+  }
+  const size_t mid = begin + (end - begin) / 2;
+  const Node& node = nodes_[mid];
+
+  if (const double chord_sq = ComputeChordSq(node.point.coords, target.coords);
+      chord_sq <= max_chord_sq) {
+    found.push_back({chord_sq, node.stop_idx});
+  }
+
+  const double diff =
+      target.coords[node.split_axis] - node.point.coords[node.split_axis];
+  if (diff < 0 || diff * diff <= max_chord_sq) {
+    SearchInRadius(begin, mid, target, max_chord_sq, found);
+  }
+  if (diff >= 0 || diff * diff <= max_chord_sq) {
+    SearchInRadius(mid + 1, end, target, max_chord_sq, found);
+  }
+}
+
+vector<SpatialIndex::Neighbour> SpatialIndex::MakeNeighbours(
+    vector<Candidate> candidates) const {
+  sort(candidates.begin(), candidates.end());
+  vector<Neighbour> neighbours;
+  neighbours.reserve(candidates.size());
+  for (const auto& [chord_sq, stop_idx] : candidates) {
+    const double half_chord = min(1.0, sqrt(chord_sq) / 2);
+    neighbours.push_back({
+        .stop_name = &stop_names_[stop_idx],
+        .distance = 2 * asin(half_chord) * Sphere::EARTH_RADIUS,
+    });
+  }
+  return neighbours;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "descriptions.h"
+#include "sphere.h"
+
+// Static k-d tree over stop positions.
+// Positions are kept as points of the unit sphere in 3D:
+// the chord between two of them grows monotonically with the great-circle
+// distance, so the tree prunes by plain euclidean bounds and stays exact.
+class SpatialIndex {
+ public:
+  explicit SpatialIndex(const Descriptions::StopsDict& stops_dict);
+
+  struct Neighbour {
+    const std::string* stop_name;
+    double distance;  // in metres
+  };
+
+  // Sorted by distance, at most count items
+  std::vector<Neighbour> FindNearest(Sphere::Point position,
+                                     size_t count) const;
+
+  // Sorted by distance, radius is in metres
+  std::vector<Neighbour> FindInRadius(Sphere::Point position,
+                                      double radius) const;
+
+ private:
+  struct Vector {
+    double coords[3];
+
+    static Vector FromPosition(Sphere::Point position);
+  };
+
+  struct Node {
+    Vector point;
+    uint32_t stop_idx;
+    uint8_t split_axis;
+  };
+
+  struct Candidate {
+    double chord_sq;
+    uint32_t stop_idx;
+
+    bool operator<(const Candidate& other) const {
+      return chord_sq < other.chord_sq;
+    }
+  };
+
+  void Build(size_t begin, size_t end);
+
+  void SearchNearest(size_t begin, size_t end, const Vector& target,
+                     size_t count, std::vector<Candidate>& heap) const;
+
+  void SearchInRadius(size_t begin, size_t end, const Vector& target,
+                      double max_chord_sq,
+                      std::vector<Candidate>& found) const;
+
+  std::vector<Neighbour> MakeNeighbours(
+      std::vector<Candidate> candidates) const;
+
+  std::vector<std::string> stop_names_;
+  // implicit tree: the node of range [begin, end) is in the middle of it
+  std::vector<Node> nodes_;
+};
@@ -3,8 +3,6 @@
 using namespace std;
 
 namespace Sphere {
-const double PI = 3.1415926535;
-
 double ConvertDegreesToRadians(double degrees) { return degrees * PI / 180.0; }
 
 Point Point::FromDegrees(double latitude, double longitude) {
@@ -12,8 +10,6 @@ Point Point::FromDegrees(double latitude, double longitude) {
           ConvertDegreesToRadians(longitude)};
 }
 
-const double EARTH_RADIUS = 6'371'000;
-
 double Distance(Point lhs, Point rhs) {
   lhs = Point::FromDegrees(lhs.latitude, lhs.longitude);
   rhs = Point::FromDegrees(rhs.latitude, rhs.longitude);
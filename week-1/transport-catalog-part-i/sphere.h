@@ -3,6 +3,9 @@
 #include <cmath>
 
 namespace Sphere {
+const double PI = 3.1415926535;
+const double EARTH_RADIUS = 6'371'000;
+
 double ConvertDegreesToRadians(double degrees);
 
 struct Point {
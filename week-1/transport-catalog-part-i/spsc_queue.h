@@ -0,0 +1,157 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Bounded lock-free queue for exactly one producer thread
+// and one consumer thread
+template <typename T>
+class SpscQueue {
+ public:
+  // Capacity is rounded up to a power of two
+  explicit SpscQueue(size_t capacity);
+
+  SpscQueue(const SpscQueue&) = delete;
+  SpscQueue& operator=(const SpscQueue&) = delete;
+
+  // Moves from value only on success, false when the queue is full
+  bool TryPush(T& value);
+  // False when the queue is empty
+  bool TryPop(T& value);
+
+  // Wait for room or for an item: spin for a while, then sleep.
+  // False once the queue is closed
+  bool Push(T& value) {
+    return Wait([&] { return PushImpl(value); });
+  }
+  bool Pop(T& value) {
+    return Wait([&] { return PopImpl(value); });
+  }
+
+  // Wakes the waiting threads, Push and Pop fail from then on
+  void Close();
+
+ private:
+  static const size_t kCacheLineSize = 64;
+  static const int kSpinCount = 100;
+
+  bool PushImpl(T& value);
+  bool PopImpl(T& value);
+
+  template <typename Operation>
+  bool Wait(Operation operation);
+  void WakeWaiters();
+
+  std::unique_ptr<T[]> items_;
+  size_t mask_;
+  // both only grow, the producer and the consumer own one each
+  alignas(kCacheLineSize) std::atomic<size_t> head_ = 0;
+  alignas(kCacheLineSize) std::atomic<size_t> tail_ = 0;
+
+  // of the sleeping threads, so that the others only lock to wake them
+  alignas(kCacheLineSize) std::atomic<int> waiter_count_ = 0;
+  std::atomic<bool> is_closed_ = false;
+  std::mutex mutex_;
+  std::condition_variable condition_;
+};
+
+template <typename T>
+SpscQueue<T>::SpscQueue(size_t capacity) {
+  size_t size = 1;
+  while (size < capacity) {
+    size *= 2;
+  }
+  items_ = std::make_unique<T[]>(size);
+  mask_ = size - 1;
+}
+
+template <typename T>
+bool SpscQueue<T>::TryPush(T& value) {
+  if (!PushImpl(value)) {
+    return false;
+  }
+  WakeWaiters();
+  return true;
+}
+
+template <typename T>
+bool SpscQueue<T>::TryPop(T& value) {
+  if (!PopImpl(value)) {
+    return false;
+  }
+  WakeWaiters();
+  return true;
+}
+
+template <typename T>
+void SpscQueue<T>::Close() {
+  is_closed_.store(true, std::memory_order_release);
+  std::lock_guard lock(mutex_);
+  condition_.notify_all();
+}
+
+template <typename T>
+bool SpscQueue<T>::PushImpl(T& value) {
+  const size_t tail = tail_.load(std::memory_order_relaxed);
+  if (tail - head_.load(std::memory_order_acquire) > mask_) {
+    return false;
+  }
+  items_[tail & mask_] = std::move(value);
+  tail_.store(tail + 1, std::memory_order_release);
+  return true;
+}
+
+template <typename T>
+bool SpscQueue<T>::PopImpl(T& value) {
+  const size_t head = head_.load(std::memory_order_relaxed);
+  if (head == tail_.load(std::memory_order_acquire)) {
+    return false;
+  }
+  value = std::move(items_[head & mask_]);
+  head_.store(head + 1, std::memory_order_release);
+  return true;
+}
+
+template <typename T>
+template <typename Operation>
+bool SpscQueue<T>::Wait(Operation operation) {
+  for (int spin = 0; spin < kSpinCount; ++spin) {
+    if (is_closed_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    if (operation()) {
+      WakeWaiters();
+      return true;
+    }
+    std::this_thread::yield();
+  }
+
+  std::unique_lock lock(mutex_);
+  waiter_count_.fetch_add(1, std::memory_order_relaxed);
+  // pairs with the fence of WakeWaiters: either the other thread sees
+  // the count, or the retry below sees its operation
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  bool is_done = false;
+  while (!is_closed_.load(std::memory_order_acquire) &&
+         !(is_done = operation())) {
+    condition_.wait(lock);
+  }
+  // the other thread may be asleep too, it is woken under the same lock
+  if (waiter_count_.fetch_sub(1, std::memory_order_relaxed) > 1) {
+    condition_.notify_all();
+  }
+  return is_done;
+}
+
+template <typename T>
+void SpscQueue<T>::WakeWaiters() {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (waiter_count_.load(std::memory_order_relaxed) > 0) {
+    std::lock_guard lock(mutex_);
+    condition_.notify_all();
+  }
+}
@@ -0,0 +1,248 @@
+#include "structural_index.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define JSON_VIEW_X86 1
+#endif
+
+using namespace std;
+
+namespace JsonView {
+
+namespace {
+
+const size_t kBlockSize = 64;
+
+// Characters of a block as bitmasks, bit i for input[i]
+struct BlockMasks {
+  uint64_t quotes = 0;
+  uint64_t backslashes = 0;
+  uint64_t operators = 0;  // {}[]:,
+  uint64_t spaces = 0;
+};
+
+using ClassifyBlock = BlockMasks (*)(const char* block);
+
+BlockMasks ClassifyScalar(const char* block) {
+  BlockMasks masks;
+  for (size_t i = 0; i < kBlockSize; ++i) {
+    const uint64_t bit = uint64_t(1) << i;
+    switch (block[i]) {
+      case '"':
+        masks.quotes |= bit;
+        break;
+      case '\\':
+        masks.backslashes |= bit;
+        break;
+      case '{':
+      case '}':
+      case '[':
+      case ']':
+      case ':':
+      case ',':
+        masks.operators |= bit;
+        break;
+      case ' ':
+      case '\t':
+      case '\n':
+      case '\r':
+        masks.spaces |= bit;
+        break;
+    }
+  }
+  return masks;
+}
+
+#ifdef JSON_VIEW_X86
+
+uint64_t MatchSse2(__m128i chunk, char c) {
+  return static_cast<uint16_t>(
+      _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(c))));
+}
+
+BlockMasks ClassifySse2(const char* block) {
+  BlockMasks masks;
+  for (size_t offset = 0; offset < kBlockSize; offset += 16) {
+    const __m128i chunk =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + offset));
+    masks.quotes |= MatchSse2(chunk, '"') << offset;
+    masks.backslashes |= MatchSse2(chunk, '\\') << offset;
+    masks.operators |=
+        (MatchSse2(chunk, '{') | MatchSse2(chunk, '}') |
+         MatchSse2(chunk, '[') | MatchSse2(chunk, ']') |
+         MatchSse2(chunk, ':') | MatchSse2(chunk, ','))
+        << offset;
+    masks.spaces |= (MatchSse2(chunk, ' ') | MatchSse2(chunk, '\t') |
+                     MatchSse2(chunk, '\n') | MatchSse2(chunk, '\r'))
+                    << offset;
+  }
+  return masks;
+}
+
+__attribute__((target("avx2"))) uint64_t MatchAvx2(__m256i chunk, char c) {
+  return static_cast<uint32_t>(
+      _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(c))));
+}
+
+__attribute__((target("avx2"))) BlockMasks ClassifyAvx2(const char* block) {
+  BlockMasks masks;
+  for (size_t offset = 0; offset < kBlockSize; offset += 32) {
+    const __m256i chunk =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + offset));
+    masks.quotes |= MatchAvx2(chunk, '"') << offset;
+    masks.backslashes |= MatchAvx2(chunk, '\\') << offset;
+    masks.operators |=
+        (MatchAvx2(chunk, '{') | MatchAvx2(chunk, '}') |
+         MatchAvx2(chunk, '[') | MatchAvx2(chunk, ']') |
+         MatchAvx2(chunk, ':') | MatchAvx2(chunk, ','))
+        << offset;
+    masks.spaces |= (MatchAvx2(chunk, ' ') | MatchAvx2(chunk, '\t') |
+                     MatchAvx2(chunk, '\n') | MatchAvx2(chunk, '\r'))
+                    << offset;
+  }
+  return masks;
+}
+
+#endif  // JSON_VIEW_X86
+
+ClassifyBlock GetClassifier(IndexImplementation implementation) {
+  switch (implementation) {
+#ifdef JSON_VIEW_X86
+    case IndexImplementation::SSE2:
+      return ClassifySse2;
+    case IndexImplementation::AVX2:
+      return ClassifyAvx2;
+#endif  // JSON_VIEW_X86
+    default:
+      return ClassifyScalar;
+  }
+}
+
+// Bit i is the parity of bits 0..i
+uint64_t PrefixXor(uint64_t bits) {
+  for (int shift = 1; shift < 64; shift *= 2) {
+    bits ^= bits << shift;
+  }
+  return bits;
+}
+
+// Characters escaped by an odd run of backslashes before them,
+// with the run possibly started in the previous block
+uint64_t FindEscaped(uint64_t backslashes, uint64_t& is_escaped_carry) {
+  const uint64_t kEvenBits = 0x5555555555555555ULL;
+  backslashes &= ~is_escaped_carry;
+  const uint64_t follows_escape = backslashes << 1 | is_escaped_carry;
+  const uint64_t odd_run_starts = backslashes & ~kEvenBits & ~follows_escape;
+  uint64_t runs_from_even_bits;
+  is_escaped_carry =
+      __builtin_add_overflow(odd_run_starts, backslashes, &runs_from_even_bits);
+  const uint64_t invert_mask = runs_from_even_bits << 1;
+  return (kEvenBits ^ invert_mask) & follows_escape;
+}
+
+// State carried from block to block
+struct Carry {
+  uint64_t is_escaped = 0;
+  uint64_t in_string = 0;  // all ones or zero
+  uint64_t after_atom = 0;  // the last character was a part of an atom
+};
+
+uint64_t FindStructurals(const BlockMasks& masks, Carry& carry) {
+  const uint64_t quotes =
+      masks.quotes & ~FindEscaped(masks.backslashes, carry.is_escaped);
+  // opening quotes and string contents, closing quotes excluded
+  const uint64_t in_string = PrefixXor(quotes) ^ carry.in_string;
+  carry.in_string = static_cast<uint64_t>(static_cast<int64_t>(in_string) >> 63);
+
+  const uint64_t atoms =
+      ~(masks.operators | masks.spaces | quotes | in_string);
+  const uint64_t atom_starts = atoms & ~(atoms << 1 | carry.after_atom);
+  carry.after_atom = atoms >> 63;
+
+  return (masks.operators & ~in_string) | quotes | atom_starts;
+}
+
+void AppendPositions(uint64_t bits, uint32_t block_begin,
+                     vector<uint32_t>& index) {
+  while (bits) {
+    index.push_back(block_begin + __builtin_ctzll(bits));
+    bits &= bits - 1;
+  }
+}
+
+}  // namespace
+
+IndexImplementation GetDefaultIndexImplementation() {
+  static const IndexImplementation implementation = [] {
+    for (const auto candidate :
+         {IndexImplementation::AVX2, IndexImplementation::SSE2}) {
+      if (IsSupported(candidate)) {
+        return candidate;
+      }
+    }
+    return IndexImplementation::SCALAR;
+  }();
+  return implementation;
+}
+
+bool IsSupported(IndexImplementation implementation) {
+  switch (implementation) {
+    case IndexImplementation::SCALAR:
+      return true;
+#ifdef JSON_VIEW_X86
+    case IndexImplementation::SSE2:
+      return __builtin_cpu_supports("sse2");
+    case IndexImplementation::AVX2:
+      return __builtin_cpu_supports("avx2");
+#endif  // JSON_VIEW_X86
+    default:
+      return false;
+  }
+}
+
+const char* GetName(IndexImplementation implementation) {
+  switch (implementation) {
+    case IndexImplementation::SCALAR:
+      return "scalar";
+    case IndexImplementation::SSE2:
+      return "sse2";
+    case IndexImplementation::AVX2:
+      return "avx2";
+  }
+  return "";
+}
+
+vector<uint32_t> BuildStructuralIndex(string_view input,
+                                      IndexImplementation implementation) {
+  if (input.size() > UINT32_MAX) {
+    throw length_error("JSON input is over 4 GiB");
+  }
+  if (!IsSupported(implementation)) {
+    implementation = IndexImplementation::SCALAR;
+  }
+  const ClassifyBlock classify = GetClassifier(implementation);
+
+  vector<uint32_t> index;
+  // a rough guess that saves most reallocations
+  index.reserve(input.size() / 8);
+  Carry carry;
+  size_t block_begin = 0;
+  for (; block_begin + kBlockSize <= input.size(); block_begin += kBlockSize) {
+    AppendPositions(
+        FindStructurals(classify(input.data() + block_begin), carry),
+        block_begin, index);
+  }
+  if (block_begin < input.size()) {
+    char last_block[kBlockSize];
+    memset(last_block, ' ', kBlockSize);
+    memcpy(last_block, input.data() + block_begin, input.size() - block_begin);
+    AppendPositions(FindStructurals(classify(last_block), carry), block_begin,
+                    index);
+  }
+  return index;
+}
+
+}  // namespace JsonView
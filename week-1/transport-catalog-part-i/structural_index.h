@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+namespace JsonView {
+
+// Stage one of parsing, after simdjson: the input is classified
+// in 64-byte blocks with bitmasks, and the result is the positions of
+// every character the parser has to look at: brackets, braces, colons
+// and commas outside strings, unescaped quotes and the first characters
+// of numbers and literals
+enum class IndexImplementation { SCALAR, SSE2, AVX2 };
+
+// Best one the CPU supports, detected once
+IndexImplementation GetDefaultIndexImplementation();
+bool IsSupported(IndexImplementation implementation);
+const char* GetName(IndexImplementation implementation);
+
+// Inputs are limited to 4 GiB
+std::vector<uint32_t> BuildStructuralIndex(
+    std::string_view input,
+    IndexImplementation implementation = GetDefaultIndexImplementation());
+
+}  // namespace JsonView
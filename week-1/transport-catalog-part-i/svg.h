@@ -3,10 +3,12 @@
 #include <cstdint>
 #include <optional>
 #include <ostream>
-#include <sstream>
 #include <string>
 #include <utility>
 #include <variant>
+#include <vector>
+
+#include "output_buffer.h"
 
 namespace Svg {
 
@@ -17,16 +19,16 @@ constexpr auto kSvgHeader =
 
 class PropertiesBuilder {
  public:
-  explicit PropertiesBuilder(std::ostream& ostream) : ostream_(ostream) {}
+  explicit PropertiesBuilder(OutputBuffer& output) : output_(output) {}
 
   template <typename T>
-  PropertiesBuilder& Add(const std::string& name, const T& value) {
-    ostream_ << name << R"(=")" << value << R"(" )";
+  PropertiesBuilder& Add(std::string_view name, const T& value) {
+    output_ << name << R"(=")" << value << R"(" )";
     return *this;
   }
 
   template <typename T>
-  PropertiesBuilder& AddOptional(const std::string& name,
+  PropertiesBuilder& AddOptional(std::string_view name,
                                  const std::optional<T>& value) {
     if (value.has_value()) {
       return Add(name, value.value());
@@ -35,21 +37,21 @@ class PropertiesBuilder {
   }
 
  private:
-  std::ostream& ostream_;
+  OutputBuffer& output_;
 };
 
 template <typename T>
 class ContentBuilder {
  public:
-  explicit ContentBuilder(std::ostream& ostream) : ostream_(ostream) {}
+  explicit ContentBuilder(OutputBuffer& output) : output_(output) {}
 
   ContentBuilder& Add(const T& value) {
-    ostream_ << value;
+    output_ << value;
     return *this;
   }
 
  private:
-  std::ostream& ostream_;
+  OutputBuffer& output_;
 };
 
 }  // namespace
@@ -82,15 +84,15 @@ class Color {
    public:
     std::string operator()(const std::string& color) { return color; }
     std::string operator()(const Rgb& rgb) {
-      std::stringstream s{};
+      OutputBuffer s{};
       s << "rgb(" << rgb.red << "," << rgb.green << "," << rgb.blue << ")";
-      return std::string{s.str()};
+      return s.Take();
     }
     std::string operator()(const Rgba& rgba) {
-      std::stringstream s{};
+      OutputBuffer s{};
       s << "rgba(" << rgba.red << "," << rgba.green << "," << rgba.blue << ","
         << rgba.alpha << ")";
-      return std::string{s.str()};
+      return s.Take();
     }
   };
 
@@ -107,23 +109,23 @@ class Tag {
 
   [[nodiscard]] const std::string& GetTag() const { return tag_; }
 
-  virtual void Render(std::ostream& ostream) const {
-    RenderOpenTag(ostream);
-    RenderProperties(ostream);
-    RenderCloseTag(ostream);
+  virtual void Render(OutputBuffer& output) const {
+    RenderOpenTag(output);
+    RenderProperties(output);
+    RenderCloseTag(output);
   }
 
  protected:
-  virtual void RenderOpenTag(std::ostream& ostream) const {
-    ostream << '<' << tag_ << ' ';
+  virtual void RenderOpenTag(OutputBuffer& output) const {
+    output << '<' << tag_ << ' ';
   }
 
-  virtual void RenderProperties(std::ostream& ostream) const {
-    PropertiesBuilder properties{ostream};
+  virtual void RenderProperties(OutputBuffer& output) const {
+    PropertiesBuilder properties{output};
     AddProperties(properties);
   }
 
-  virtual void RenderCloseTag(std::ostream& ostream) const { ostream << "/>"; }
+  virtual void RenderCloseTag(OutputBuffer& output) const { output << "/>"; }
 
   virtual void AddProperties(PropertiesBuilder& /*properties*/) const {}
 
@@ -137,22 +139,22 @@ class TagWithContent : public Tag {
   explicit TagWithContent(const std::string& tag) : Tag(tag) {}
   explicit TagWithContent(std::string&& tag) : Tag(tag) {}
 
-  void Render(std::ostream& ostream) const override {
-    RenderOpenTag(ostream);
-    RenderProperties(ostream);
-    RenderContent(ostream);
-    RenderCloseTag(ostream);
+  void Render(OutputBuffer& output) const override {
+    RenderOpenTag(output);
+    RenderProperties(output);
+    RenderContent(output);
+    RenderCloseTag(output);
   }
 
  protected:
-  virtual void RenderContent(std::ostream& ostream) const {
-    ostream << '>';
-    ContentBuilder<T> builder{ostream};
+  virtual void RenderContent(OutputBuffer& output) const {
+    output << '>';
+    ContentBuilder<T> builder{output};
     AddContent(builder);
   }
 
-  void RenderCloseTag(std::ostream& ostream) const override {
-    ostream << "</" << GetTag() << '>';
+  void RenderCloseTag(OutputBuffer& output) const override {
+    output << "</" << GetTag() << '>';
   }
 
   virtual void AddContent(ContentBuilder<T>& builder) const = 0;
@@ -253,23 +255,21 @@ class Polyline : public Tag, public BaseProperties<Polyline> {
   // записываемый в виде x,y и отделяемый пробелами от соседних элементов.
   // Значение свойства по умолчанию: пустая строка.
   Polyline& AddPoint(const Point& point) {
-    if (!points_.empty()) {
-      points_.push_back(' ');
+    if (points_.GetSize() > 0) {
+      points_ << ' ';
     }
-    std::stringstream s{};
-    s << point.x << "," << point.y;
-    points_.append(s.str());
+    points_ << point.x << ',' << point.y;
     return *this;
   }
 
  protected:
   void AddProperties(PropertiesBuilder& builder) const override {
     BaseProperties::AddProperties(builder);
-    builder.Add("points", points_);
+    builder.Add("points", points_.View());
   }
 
  private:
-  std::string points_{};
+  OutputBuffer points_{};
 };
 
 class Text : public TagWithContent<std::string>, public BaseProperties<Text> {
@@ -345,19 +345,24 @@ class Text : public TagWithContent<std::string>, public BaseProperties<Text> {
 
 class Document {
  public:
-  Document() : stream_() {}
+  Document() : buffer_() {}
+
+  void Add(const Tag& tag) { tag.Render(buffer_); }
 
-  void Add(const Tag& tag) { tag.Render(stream_); }
+  void Render(OutputBuffer& output) const {
+    output << kSvgHeader;
+    output << R"(<svg xmlns="http://www.w3.org/2000/svg" version="1.1">)";
+    output << buffer_.View();
+    output << "</svg>";
+  }
 
   void Render(std::ostream& ostream) const {
-    ostream << kSvgHeader;
-    ostream << R"(<svg xmlns="http://www.w3.org/2000/svg" version="1.1">)";
-    ostream << stream_.str();
-    ostream << "</svg>";
+    OutputBuffer output(ostream);
+    Render(output);
   }
 
  private:
-  std::stringstream stream_;
+  OutputBuffer buffer_;
 };
 
 }  // namespace Svg
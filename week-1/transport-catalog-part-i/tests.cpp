@@ -1,9 +1,23 @@
 #include "tests.h"
 
+#include <limits>
+#include <random>
+#include <thread>
+
+#include "catalog_holder.h"
+#include "distance_table.h"
 #include "json.h"
+#include "json_cbor.h"
+#include "json_sax.h"
+#include "json_view.h"
+#include "profile.h"
 #include "requests.h"
+#include "server.h"
+#include "spatial_index.h"
+#include "structural_index.h"
 #include "svg.h"
 #include "test_runner.h"
+#include "thread_pool.h"
 #include "transport_catalog.h"
 
 namespace {
@@ -456,18 +470,27 @@ void CourseraSvgExample() {
   ASSERT_EQUAL(stream.str(), kCourseraExampleSvg);
 }
 
-void MakeRequest(std::istream& input, std::ostream& output) {
-  const auto input_doc = Json::Load(input);
-  const auto& input_map = input_doc.GetRoot().AsMap();
-
-  const TransportCatalog db(
+// Catalog of the base_requests and the settings of the input
+TransportCatalog MakeCatalog(const Json::Dict& input_map,
+                             const Json::Dict& serving_settings = {}) {
+  ThreadPool pool;
+  return TransportCatalog(
       Descriptions::ReadDescriptions(input_map.at("base_requests").AsArray()),
       input_map.at("routing_settings").AsMap(),
-      input_map.at("render_settings").AsMap());
+      input_map.at("render_settings").AsMap(), serving_settings, pool);
+}
 
-  Json::PrintValue(
-      Requests::ProcessAll(db, input_map.at("stat_requests").AsArray()),
-      output);
+// Input of most tests below
+Json::Document LoadPartHFirstRequest() {
+  std::stringstream input{kPartHFirstRequest.data()};
+  return Json::Load(input);
+}
+
+void MakeRequest(std::istream& input, OutputBuffer& output) {
+  const auto input_doc = Json::Load(input);
+  const auto& input_map = input_doc.GetRoot().AsMap();
+  const TransportCatalog db = MakeCatalog(input_map);
+  Requests::ProcessAll(db, input_map.at("stat_requests").AsArray(), output);
 }
 
 std::stringstream MakeExpectedFromJson(const std::string_view view) {
@@ -480,12 +503,12 @@ std::stringstream MakeExpectedFromJson(const std::string_view view) {
 void AssertCourseraTest(const std::string_view request,
                   const std::string_view response) {
   std::stringstream input{request.data()};
-  std::stringstream output{};
+  OutputBuffer output;
 
   const std::stringstream expected = MakeExpectedFromJson(response);
 
   MakeRequest(input, output);
-  ASSERT_EQUAL(output.str(), expected.str());
+  ASSERT_EQUAL(output.Take(), expected.str());
 }
 
 void CourseraPartEFirstCase() {
@@ -494,9 +517,9 @@ void CourseraPartEFirstCase() {
 
 void CourseraPartHFirstCase() {
   std::stringstream input{kPartHFirstRequest.data()};
-  std::stringstream output{};
+  OutputBuffer output;
   MakeRequest(input, output);
-  ASSERT_EQUAL(output.str(), kPartHFirstResponse);
+  ASSERT_EQUAL(output.View(), kPartHFirstResponse);
 }
 
 void TestJsonEscape() {
@@ -508,6 +531,813 @@ void TestJsonEscape() {
   ASSERT_EQUAL(output.str(), expected);
 }
 
+void TestJsonEscapeRoundTrip() {
+  const std::string_view input = R"(["A\\B", "x\ny\"\u0001"])";
+  Json::NodeBuilder builder;
+  Json::Parse(input, builder);
+  const Json::Node node = builder.TakeResult();
+  ASSERT_EQUAL(node.AsArray()[0].AsString(), "A\\B");
+  ASSERT_EQUAL(node.AsArray()[1].AsString(), "x\ny\"\x01");
+
+  OutputBuffer output;
+  Json::PrintNode(node, output);
+  ASSERT_EQUAL(output.View(), input);
+  Json::Parse(output.View(), builder);
+  const Json::Node parsed = builder.TakeResult();
+  ASSERT_EQUAL(parsed.AsArray()[0].AsString(), "A\\B");
+  ASSERT_EQUAL(parsed.AsArray()[1].AsString(), "x\ny\"\x01");
+}
+
+void TestJsonDictKeepsFirstKey() {
+  std::stringstream input{R"({"b": 1, "a": 2, "b": 3})"};
+  Json::Dict dict = Json::Load(input).GetRoot().AsMap();
+  ASSERT_EQUAL(dict.size(), 2u);
+  ASSERT_EQUAL(dict.begin()->first.str(), "a");
+  ASSERT_EQUAL(dict.at("b").AsInt(), 1);
+  ASSERT(!dict.emplace("a", Json::Node(4)).second);
+  dict["c"] = Json::Node(5);
+  ASSERT_EQUAL(dict.count("c"), 1u);
+  ASSERT_EQUAL(dict.count("d"), 0u);
+
+  std::stringstream output{};
+  Json::PrintNode(dict, output);
+  ASSERT_EQUAL(output.str(), R"({"a": 2, "b": 1, "c": 5})");
+}
+
+void TestJsonKeysInterned() {
+  std::stringstream input{R"([{"name": 1, "type": 2}, {"type": 3}])"};
+  const auto document = Json::Load(input);
+  const auto& items = document.GetRoot().AsArray();
+  const Json::Key type = items[0].AsMap().begin()[1].first;
+  ASSERT(type == items[1].AsMap().begin()->first);
+  ASSERT(&type.str() == &items[1].AsMap().begin()->first.str());
+  ASSERT(type == Json::Key("type"));
+  ASSERT(type != Json::Key("name"));
+  ASSERT(type == "type");
+
+  // keys of other threads are the same handles
+  bool is_shared = false;
+  std::thread([&] { is_shared = Json::Key("type") == type; }).join();
+  ASSERT(is_shared);
+}
+
+void TestJsonNumbers() {
+  const std::string json =
+      "[3000000000, -12, 0.1, 1.5e3, -2E-2, 123456789.125, 7]";
+  std::stringstream input{json};
+  const Json::Array nodes = Json::Load(input).GetRoot().AsArray();
+  ASSERT_EQUAL(nodes[0].AsInt64(), 3000000000);
+  ASSERT_EQUAL(nodes[1].AsInt(), -12);
+  ASSERT_EQUAL(nodes[2].AsDouble(), 0.1);
+  ASSERT_EQUAL(nodes[3].AsDouble(), 1500.0);
+  ASSERT_EQUAL(nodes[4].AsDouble(), -0.02);
+  bool is_thrown = false;
+  try {
+    nodes[0].AsInt();
+  } catch (const std::out_of_range&) {
+    is_thrown = true;
+  }
+  ASSERT(is_thrown);
+
+  const std::string expected =
+      "[3000000000, -12, 0.1, 1500, -0.02, 1.23457e+08, 7]";
+  std::stringstream output{};
+  Json::PrintNode(nodes, output);
+  ASSERT_EQUAL(output.str(), expected);
+
+  const JsonView::Document document(JsonView::MappedInput::FromString(json));
+  std::stringstream view_output{};
+  Json::PrintNode(document.GetRoot().ToJson(), view_output);
+  ASSERT_EQUAL(view_output.str(), expected);
+
+  // longer than any buffer: read whole, rounded
+  const std::string long_number = "0." + std::string(100, '3');
+  std::stringstream long_input{"[" + long_number + ", 2, {\"a\": " +
+                               long_number + ", \"b\": 3}]"};
+  const Json::Array long_nodes = Json::Load(long_input).GetRoot().AsArray();
+  ASSERT_EQUAL(long_nodes.size(), 3u);
+  ASSERT_EQUAL(long_nodes[0].AsDouble(), 1.0 / 3);
+  ASSERT_EQUAL(long_nodes[1].AsInt(), 2);
+  ASSERT_EQUAL(long_nodes[2].AsMap().size(), 2u);
+  ASSERT_EQUAL(long_nodes[2].AsMap().at("b").AsInt(), 3);
+}
+
+// Writes the events back as JSON
+class EchoHandler : public Json::Handler {
+ public:
+  explicit EchoHandler(OutputBuffer& output) : writer_(output) {}
+
+  void OnStartObject() { writer_.BeginObject(); }
+  void OnKey(std::string_view key) { writer_.Key(key); }
+  void OnEndObject() { writer_.EndObject(); }
+  void OnStartArray() { writer_.BeginArray(); }
+  void OnEndArray() { writer_.EndArray(); }
+  void OnString(std::string_view value) { writer_.Value(value); }
+  void OnNumber(Json::Number value) {
+    std::visit([this](auto value) { writer_.Value(value); }, value);
+  }
+  void OnBool(bool value) { writer_.Value(value); }
+
+ private:
+  Json::Writer writer_;
+};
+
+// Keys sorted, as Json::Print does
+std::string NormalizeJson(const std::string& json) {
+  std::stringstream input{json};
+  std::stringstream output{};
+  Json::Print(Json::Load(input), output);
+  return output.str();
+}
+
+void TestSaxMatchesLoad() {
+  const std::string input{kPartHFirstRequest};
+  OutputBuffer buffer_output;
+  EchoHandler buffer_handler(buffer_output);
+  Json::Parse(input, buffer_handler);
+  ASSERT_EQUAL(NormalizeJson(std::string(buffer_output.View())),
+               NormalizeJson(input));
+
+  std::stringstream stream_input{input + " tail"};
+  OutputBuffer stream_output;
+  EchoHandler stream_handler(stream_output);
+  Json::Parse(stream_input, stream_handler);
+  ASSERT_EQUAL(stream_output.View(), buffer_output.View());
+  std::string tail;
+  stream_input >> tail;
+  ASSERT_EQUAL(tail, "tail");
+
+  std::stringstream long_input{"[0." + std::string(100, '3') + ", 2]"};
+  OutputBuffer long_output;
+  EchoHandler long_handler(long_output);
+  Json::Parse(long_input, long_handler);
+  ASSERT_EQUAL(long_output.View(), "[0.333333, 2]");
+}
+
+void TestSaxFieldSet() {
+  std::string name;
+  double latitude = 0;
+  int count = 0;
+  bool is_roundtrip = false;
+  Json::FieldSet fields;
+  fields.Bind("name", &name)
+      .Bind("latitude", &latitude)
+      .Bind("count", &count)
+      .Bind("is_roundtrip", &is_roundtrip);
+
+  struct FieldsHandler : Json::Handler {
+    const Json::FieldSet& fields;
+    std::string key;
+
+    void OnKey(std::string_view value) { key = value; }
+    void OnString(std::string_view value) { fields.Set(key, value); }
+    void OnNumber(Json::Number value) { fields.Set(key, value); }
+    void OnBool(bool value) { fields.Set(key, value); }
+  } handler{{}, fields, {}};
+  Json::Parse(
+      R"({"name": "a\"b\u0416", "latitude": 5, "count": -3,
+          "is_roundtrip": true, "other": [1, 2.5e1, null]})",
+      handler);
+  ASSERT_EQUAL(name, "a\"b\u0416");
+  ASSERT_EQUAL(latitude, 5.0);
+  ASSERT_EQUAL(count, -3);
+  ASSERT(is_roundtrip);
+
+  bool is_thrown = false;
+  try {
+    fields.Set("count", Json::Number(1.5));
+  } catch (const std::bad_variant_access&) {
+    is_thrown = true;
+  }
+  ASSERT(is_thrown);
+}
+
+void TestCborRoundTrip() {
+  const auto document = LoadPartHFirstRequest();
+  std::stringstream cbor{};
+  Json::PrintCbor(document.GetRoot(), cbor);
+  ASSERT(Json::DetectFormat(cbor.str()) == Json::Format::CBOR);
+  ASSERT(Json::DetectFormat(kPartHFirstRequest) == Json::Format::JSON);
+  std::stringstream expected{};
+  Json::Print(document, expected);
+  std::stringstream output{};
+  Json::Print(Json::LoadCbor(cbor.str()), output);
+  ASSERT_EQUAL(output.str(), expected.str());
+
+  // indefinite lengths, a half float, a chunked string, a tag
+  // and an integer beyond int64_t
+  const char items[] =
+      "\x9f\xf9\x3e\x00\x7f\x61\x61\x62\x62\x63\xff\xc1\x1a\x00\x01"
+      "\x00\x00\x3a\x7f\xff\xff\xff\x1b\xff\xff\xff\xff\xff\xff\xff"
+      "\xff\xff";
+  std::stringstream items_output{};
+  Json::Print(Json::LoadCbor({items, sizeof(items) - 1}), items_output);
+  ASSERT_EQUAL(items_output.str(),
+               R"([1.5, "abc", 65536, -2147483648, 1.84467e+19])");
+}
+
+void TestCborResponsesMatchJson() {
+  const auto input_doc = LoadPartHFirstRequest();
+  const auto& input_map = input_doc.GetRoot().AsMap();
+  const TransportCatalog db = MakeCatalog(
+      input_map, Json::Dict{{"precompute_responses", Json::Node(true)}});
+
+  // duplicates go through templates
+  std::vector<Json::Node> requests;
+  for (int i = 0; i < 2; ++i) {
+    for (const auto& request : input_map.at("stat_requests").AsArray()) {
+      requests.push_back(request);
+    }
+  }
+  OutputBuffer expected;
+  Requests::ProcessAll(db, requests, expected);
+
+  for (const size_t worker_count : {1, 3}) {
+    OutputBuffer cbor;
+    Requests::ProcessAll(db, requests, cbor, worker_count,
+                         Json::Format::CBOR);
+    OutputBuffer output;
+    Json::Print(Json::LoadCbor(cbor.View()), output);
+    ASSERT_EQUAL(output.View(), expected.View());
+  }
+}
+
+void TestParallelForCoversRange() {
+  ThreadPool pool(3);
+  std::vector<int> visits(10);
+  ParallelFor(pool, visits.size(), [&visits](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      ++visits[i];
+    }
+  });
+  ASSERT_EQUAL(visits, std::vector<int>(10, 1));
+}
+
+void TestCatalogHolderRefresh() {
+  std::stringstream old_input{kPartEFirstRequest.data()};
+  CatalogHolder holder(
+      CatalogHolder::Build(Json::Load(old_input).GetRoot().AsMap()));
+  const auto old_snapshot = holder.Acquire();
+
+  holder.Refresh(LoadPartHFirstRequest()).get();
+
+  ASSERT(old_snapshot->GetBus("297") != nullptr);
+  ASSERT(holder.Acquire()->GetBus("297") == nullptr);
+  ASSERT(holder.Acquire()->GetBus("14") != nullptr);
+}
+
+void TestPrecomputedResponses() {
+  std::stringstream input{kPartEFirstRequest.data()};
+  const auto input_doc = Json::Load(input);
+  const auto& input_map = input_doc.GetRoot().AsMap();
+  const auto& stat_requests = input_map.at("stat_requests").AsArray();
+
+  const auto make_catalog = [&input_map](bool precompute_responses) {
+    ThreadPool pool;
+    return TransportCatalog(
+        Descriptions::ReadDescriptions(
+            input_map.at("base_requests").AsArray()),
+        input_map.at("routing_settings").AsMap(),
+        input_map.at("render_settings").AsMap(),
+        Json::Dict{
+            {"precompute_responses", Json::Node(precompute_responses)}},
+        pool);
+  };
+  const TransportCatalog db = make_catalog(true);
+  ASSERT(db.GetStop("Universam")->serialized.has_value());
+
+  OutputBuffer expected;
+  Requests::ProcessAll(make_catalog(false), stat_requests, expected);
+  OutputBuffer output;
+  Requests::ProcessAll(db, stat_requests, output);
+  ASSERT_EQUAL(output.View(), expected.View());
+}
+
+void TestSpatialIndexMatchesBruteForce() {
+  const auto input_doc = LoadPartHFirstRequest();
+  const auto descriptions = Descriptions::ReadDescriptions(
+      input_doc.GetRoot().AsMap().at("base_requests").AsArray());
+  Descriptions::StopsDict stops_dict;
+  for (const auto& item : descriptions) {
+    if (const auto* stop = std::get_if<Descriptions::Stop>(&item)) {
+      stops_dict[stop->name] = stop;
+    }
+  }
+  const SpatialIndex index(stops_dict);
+  const Sphere::Point center{.latitude = 43.587795, .longitude = 39.716901};
+
+  std::vector<std::pair<double, std::string>> expected;
+  for (const auto& [name, stop] : stops_dict) {
+    expected.emplace_back(Sphere::Distance(center, stop->position), name);
+  }
+  std::sort(expected.begin(), expected.end());
+
+  const auto nearest = index.FindNearest(center, 4);
+  ASSERT_EQUAL(nearest.size(), 4u);
+  ASSERT_EQUAL(*nearest[0].stop_name, "Ривьерский мост");
+  for (size_t i = 1; i < nearest.size(); ++i) {
+    ASSERT_EQUAL(*nearest[i].stop_name, expected[i].second);
+    ASSERT(std::abs(nearest[i].distance - expected[i].first) < 1e-3);
+  }
+
+  const auto in_radius = index.FindInRadius(center, expected[3].first + 1);
+  ASSERT_EQUAL(in_radius.size(), 4u);
+  ASSERT_EQUAL(*in_radius.back().stop_name, expected[3].second);
+}
+
+void TestNearestStopsRejectsNegativeCount() {
+  Json::Dict request{{"id", Json::Node(1)},
+                     {"type", Json::Node(std::string("NearestStops"))},
+                     {"latitude", Json::Node(43.59)},
+                     {"longitude", Json::Node(39.74)},
+                     {"count", Json::Node(2)}};
+  ASSERT_EQUAL(std::get<Requests::NearestStops>(Requests::Read(request)).count,
+               2u);
+
+  request["count"] = Json::Node(-1);
+  bool is_rejected = false;
+  try {
+    Requests::Read(request);
+  } catch (const std::invalid_argument&) {
+    is_rejected = true;
+  }
+  ASSERT(is_rejected);
+}
+
+std::string ReplaceAll(std::string text, std::string_view from,
+                       std::string_view to) {
+  for (size_t pos = text.find(from); pos != std::string::npos;
+       pos = text.find(from, pos + to.size())) {
+    text.replace(pos, from.size(), to);
+  }
+  return text;
+}
+
+void TestStreamingInput() {
+  // an escaped name is read the same way by every reader of the input
+  const std::string escaped_name = R"(Морской\\вокзал)";
+  for (const auto& [request, response] :
+       {std::pair{std::string(kPartHFirstRequest),
+                  std::string(kPartHFirstResponse)},
+        std::pair{
+            ReplaceAll(std::string(kPartHFirstRequest), "Морской вокзал",
+                       escaped_name),
+            ReplaceAll(std::string(kPartHFirstResponse), "Морской вокзал",
+                       escaped_name)}}) {
+    std::stringstream input{request};
+    OutputBuffer output;
+    Requests::ProcessInput(input, output);
+    ASSERT_EQUAL(output.View(), response);
+
+    // stat_requests ahead of the settings are processed once all is read
+    std::stringstream document_input{request};
+    const auto input_doc = Json::Load(document_input);
+    const auto& input_map = input_doc.GetRoot().AsMap();
+    OutputBuffer reordered;
+    reordered.SetPrecision(std::numeric_limits<double>::max_digits10);
+    reordered << R"({"stat_requests": )";
+    Json::PrintNode(input_map.at("stat_requests"), reordered);
+    for (const char* key :
+         {"base_requests", "routing_settings", "render_settings"}) {
+      reordered << ", \"" << key << "\": ";
+      Json::PrintNode(input_map.at(key), reordered);
+    }
+    reordered << '}';
+    std::stringstream reordered_input{reordered.Take()};
+    OutputBuffer reordered_output;
+    Requests::ProcessInput(reordered_input, reordered_output);
+    ASSERT_EQUAL(reordered_output.View(), response);
+  }
+}
+
+void TestDistanceTableFallsBackToReverse() {
+  Descriptions::Stop lhs{.name = "A", .distances = {{"B", 100}}};
+  Descriptions::Stop rhs{.name = "B", .distances = {{"C", 30}}};
+  Descriptions::Stop third{.name = "C", .distances = {{"B", 20}}};
+  const DistanceTable distances(
+      Descriptions::StopsDict{{"A", &lhs}, {"B", &rhs}, {"C", &third}});
+
+  const auto ids = distances.GetStopIds({"A", "B", "C"});
+  ASSERT_EQUAL(distances.Get(ids[0], ids[1]), 100);
+  ASSERT_EQUAL(distances.Get(ids[1], ids[0]), 100);
+  ASSERT_EQUAL(distances.Get(ids[1], ids[2]), 30);
+  ASSERT_EQUAL(distances.Get(ids[2], ids[1]), 20);
+}
+
+void TestDistanceTableSkipsUnknownStops() {
+  Descriptions::Stop lhs{.name = "A", .distances = {{"B", 100}, {"X", 5}}};
+  Descriptions::Stop rhs{.name = "B"};
+  const DistanceTable distances(
+      Descriptions::StopsDict{{"A", &lhs}, {"B", &rhs}});
+
+  const auto ids = distances.GetStopIds({"A", "B"});
+  ASSERT_EQUAL(distances.Get(ids[1], ids[0]), 100);
+}
+
+void TestParallelPartitionMatchesSequential() {
+  ThreadPool pool(3);
+  std::vector<int> items{5, 2, 8, 1, 4, 7, 6, 3, 9, 10, 12, 11, 13};
+  std::vector<int> expected = items;
+  const auto is_odd = [](int item) { return item % 2 != 0; };
+
+  const auto expected_end = std::partition(expected.begin(), expected.end(),
+                                           is_odd);
+  const auto odd_end = ParallelPartition(pool, items, is_odd);
+  ASSERT_EQUAL(items, expected);
+  ASSERT_EQUAL(odd_end - items.begin(), expected_end - expected.begin());
+}
+
+void TestParallelDescriptions() {
+  const auto input_doc = LoadPartHFirstRequest();
+  const auto& nodes = input_doc.GetRoot().AsMap().at("base_requests").AsArray();
+
+  ThreadPool pool(4);
+  const auto expected = Descriptions::ReadDescriptions(nodes);
+  const auto descriptions = Descriptions::ReadDescriptions(nodes, pool);
+  ASSERT_EQUAL(descriptions.size(), expected.size());
+  for (size_t i = 0; i < expected.size(); ++i) {
+    ASSERT_EQUAL(descriptions[i].index(), expected[i].index());
+    ASSERT_EQUAL(std::visit([](const auto& item) { return item.name; },
+                            descriptions[i]),
+                 std::visit([](const auto& item) { return item.name; },
+                            expected[i]));
+  }
+}
+
+void TestConsumingDescriptions() {
+  const auto input_doc = LoadPartHFirstRequest();
+  const auto& nodes = input_doc.GetRoot().AsMap().at("base_requests").AsArray();
+  const auto expected = Descriptions::ReadDescriptions(nodes);
+
+  ThreadPool pool(3);
+  for (const bool is_parallel : {false, true}) {
+    std::vector<Json::Node> consumed = nodes;
+    const auto descriptions =
+        is_parallel ? Descriptions::ReadDescriptions(std::move(consumed), pool)
+                    : Descriptions::ReadDescriptions(std::move(consumed));
+    ASSERT_EQUAL(descriptions.size(), expected.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+      if (const auto* bus = std::get_if<Descriptions::Bus>(&expected[i])) {
+        const auto& result = std::get<Descriptions::Bus>(descriptions[i]);
+        ASSERT_EQUAL(result.name, bus->name);
+        ASSERT_EQUAL(result.stops, bus->stops);
+        ASSERT_EQUAL(result.is_roundtrip, bus->is_roundtrip);
+      } else {
+        const auto& stop = std::get<Descriptions::Stop>(expected[i]);
+        const auto& result = std::get<Descriptions::Stop>(descriptions[i]);
+        ASSERT_EQUAL(result.name, stop.name);
+        ASSERT(result.distances == stop.distances);
+      }
+    }
+  }
+
+  Json::Node node(std::string(64, 'x'));
+  const char* const data = node.AsString().data();
+  const std::string taken = std::move(node).TakeString();
+  ASSERT_EQUAL(taken.data(), data);
+}
+
+void TestReadWorkerCountClamps() {
+  const size_t default_count = ThreadPool::GetDefaultThreadCount();
+  const auto read = [](int64_t workers) {
+    return Requests::ReadWorkerCount(Json::Dict{{"workers", workers}});
+  };
+  ASSERT_EQUAL(read(-3), 1u);
+  ASSERT_EQUAL(read(0), 1u);
+  ASSERT_EQUAL(read(2), std::min<size_t>(2, 4 * default_count));
+  ASSERT_EQUAL(read(int64_t(1) << 40), 4 * default_count);
+
+  const char* const variable = "TRANSPORT_CATALOG_WORKERS";
+  const char* const previous = getenv(variable);
+  const std::string previous_value = previous ? previous : "";
+  setenv(variable, "many", 1);
+  ASSERT_EQUAL(Requests::ReadWorkerCount({}), default_count);
+  setenv(variable, "-1", 1);
+  ASSERT_EQUAL(Requests::ReadWorkerCount({}), 1u);
+  if (previous) {
+    setenv(variable, previous_value.c_str(), 1);
+  } else {
+    unsetenv(variable);
+  }
+}
+
+void TestParallelRequestsKeepOrder() {
+  const auto input_doc = LoadPartHFirstRequest();
+  const auto& input_map = input_doc.GetRoot().AsMap();
+  const TransportCatalog db = MakeCatalog(input_map);
+
+  std::vector<Json::Node> requests;
+  for (int i = 0; i < 20; ++i) {
+    for (const auto& request : input_map.at("stat_requests").AsArray()) {
+      requests.push_back(request);
+    }
+  }
+  OutputBuffer expected;
+  Requests::ProcessAll(db, requests, expected);
+  OutputBuffer output;
+  Requests::ProcessAll(db, requests, output, 4);
+  ASSERT_EQUAL(output.View(), expected.View());
+}
+
+void TestDuplicateRequestsCoalesced() {
+  const auto input_doc = LoadPartHFirstRequest();
+  const auto& input_map = input_doc.GetRoot().AsMap();
+  const TransportCatalog db = MakeCatalog(input_map);
+
+  std::vector<Json::Node> requests;
+  int id = 0;
+  for (int i = 0; i < 3; ++i) {
+    for (const auto& request : input_map.at("stat_requests").AsArray()) {
+      Json::Dict request_json = request.AsMap();
+      request_json["id"] = Json::Node(++id);
+      requests.emplace_back(std::move(request_json));
+    }
+  }
+  OutputBuffer expected;
+  Json::Writer writer(expected);
+  writer.BeginArray();
+  for (const auto& request : requests) {
+    Requests::Process(db, request.AsMap(), writer);
+  }
+  writer.EndArray();
+
+  OutputBuffer output;
+  Requests::ProcessAll(db, requests, output);
+  ASSERT_EQUAL(output.View(), expected.View());
+  OutputBuffer parallel_output;
+  Requests::ProcessAll(db, requests, parallel_output, 4);
+  ASSERT_EQUAL(parallel_output.View(), expected.View());
+}
+
+void TestNearDuplicateRequestsKeptApart() {
+  const auto input_doc = LoadPartHFirstRequest();
+  const auto& input_map = input_doc.GetRoot().AsMap();
+  const TransportCatalog db = MakeCatalog(input_map);
+
+  // at "Улица Лизы Чайкиной" and about 3 m away, equal in 6 digits
+  std::vector<Json::Node> requests;
+  int id = 0;
+  for (const double latitude : {43.590317, 43.590347, 43.590317}) {
+    requests.emplace_back(
+        Json::Dict{{"id", Json::Node(++id)},
+                   {"type", Json::Node(std::string("StopsInRadius"))},
+                   {"latitude", Json::Node(latitude)},
+                   {"longitude", Json::Node(39.746833)},
+                   {"radius", Json::Node(1.0)}});
+  }
+  OutputBuffer expected;
+  Json::Writer writer(expected);
+  writer.BeginArray();
+  for (const auto& request : requests) {
+    Requests::Process(db, request.AsMap(), writer);
+  }
+  writer.EndArray();
+  ASSERT(expected.View().find(R"("stops": [])") != std::string_view::npos);
+
+  OutputBuffer output;
+  Requests::ProcessAll(db, requests, output);
+  ASSERT_EQUAL(output.View(), expected.View());
+}
+
+void TestProcessStreamMatchesProcessAll() {
+  const auto input_doc = LoadPartHFirstRequest();
+  const auto& input_map = input_doc.GetRoot().AsMap();
+  const TransportCatalog db = MakeCatalog(input_map);
+
+  std::vector<Json::Node> requests;
+  for (int i = 0; i < 50; ++i) {
+    for (const auto& request : input_map.at("stat_requests").AsArray()) {
+      requests.push_back(request);
+    }
+  }
+  OutputBuffer expected;
+  Requests::ProcessAll(db, requests, expected);
+
+  for (const size_t worker_count : {1, 3}) {
+    std::stringstream requests_input{};
+    Json::PrintValue(requests, requests_input);
+    OutputBuffer output;
+    Requests::ProcessStream(db, requests_input, output, worker_count);
+    ASSERT_EQUAL(output.View(), expected.View());
+  }
+}
+
+void TestJsonViewMatchesJson() {
+  std::stringstream expected{};
+  Json::Print(LoadPartHFirstRequest(), expected);
+
+  const JsonView::Document document(
+      JsonView::MappedInput::FromString(kPartHFirstRequest));
+  std::stringstream output{};
+  Json::PrintNode(document.GetRoot().ToJson(), output);
+  ASSERT_EQUAL(output.str(), expected.str());
+
+  const auto base_requests =
+      document.GetRoot().AsMap().at("base_requests").AsArray();
+  ASSERT_EQUAL(Descriptions::ReadDescriptions(base_requests).size(), 13u);
+
+  const JsonView::Document escaped(JsonView::MappedInput::FromString(
+      R"({"a\"b": ["\\x\n", "\u0416\ud83d\ude00", -1.5, true]})"));
+  const auto object = escaped.GetRoot().AsMap();
+  ASSERT_EQUAL(object.size(), 1u);
+  const auto items = object.at("a\"b").AsArray();
+  ASSERT_EQUAL(items[0].AsString(), "\\x\n");
+  ASSERT_EQUAL(items[1].AsString(), "\u0416\U0001F600");
+  ASSERT_EQUAL(items[2].AsDouble(), -1.5);
+  ASSERT(items[3].AsBool());
+  ASSERT_EQUAL(object.count("b"), 0u);
+}
+
+void TestJsonViewLazyMatchesEager() {
+  const JsonView::Document eager_document(
+      JsonView::MappedInput::FromString(kPartHFirstRequest));
+  std::stringstream expected{};
+  Json::PrintNode(eager_document.GetRoot().ToJson(), expected);
+
+  const JsonView::Document document(
+      JsonView::MappedInput::FromString(kPartHFirstRequest),
+      JsonView::GetDefaultIndexImplementation(), JsonView::ParseMode::LAZY);
+  const auto routing_settings =
+      document.GetRoot().AsMap().at("routing_settings").AsMap();
+  ASSERT_EQUAL(routing_settings.at("bus_velocity").AsInt(), 30);
+
+  // lazy nodes are parsed by whichever thread comes first
+  ThreadPool pool(4);
+  std::vector<std::string> outputs(8);
+  ParallelForDynamic(pool, outputs.size(), 1, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      std::stringstream output{};
+      Json::PrintNode(document.GetRoot().ToJson(), output);
+      outputs[i] = output.str();
+    }
+  });
+  ASSERT_EQUAL(outputs, std::vector<std::string>(8, expected.str()));
+
+  // containers not parsed yet are converted from the input,
+  // with their strings unescaped, next to parsed ones
+  const std::string_view escaped_input =
+      R"({"a": [{"s": "x\"y\\z"}, 1], "b": {"c": ["\"", 2.5]}})";
+  std::stringstream escaped_expected{};
+  Json::PrintNode(
+      JsonView::Document(JsonView::MappedInput::FromString(escaped_input))
+          .GetRoot()
+          .ToJson(),
+      escaped_expected);
+  const JsonView::Document escaped_document(
+      JsonView::MappedInput::FromString(escaped_input),
+      JsonView::GetDefaultIndexImplementation(), JsonView::ParseMode::LAZY);
+  const JsonView::Node& b = escaped_document.GetRoot().AsMap().at("b");
+  ASSERT_EQUAL(b.AsMap().at("c").AsArray()[0].AsString(), "\"");
+  std::stringstream escaped_output{};
+  Json::PrintNode(escaped_document.GetRoot().ToJson(), escaped_output);
+  ASSERT_EQUAL(escaped_output.str(), escaped_expected.str());
+}
+
+void TestParallelLoadMatchesLoad() {
+  ThreadPool pool(3);
+  for (const std::string_view input :
+       {kPartHFirstRequest, std::string_view(R"([{"a": [1, "]"]}, 2.5,
+            "x\"y", [[]], {}, true])")}) {
+    std::stringstream json_input{std::string(input)};
+    std::stringstream expected{};
+    Json::Print(Json::Load(json_input), expected);
+    std::stringstream output{};
+    Json::Print(
+        JsonView::LoadAsJson(JsonView::MappedInput::FromString(input), pool),
+        output);
+    ASSERT_EQUAL(output.str(), expected.str());
+  }
+}
+
+// Backslashes escape the next character outside strings too,
+// as in the SIMD index
+std::vector<uint32_t> BuildStructuralIndexNaive(std::string_view input) {
+  std::vector<uint32_t> index;
+  bool in_string = false;
+  bool is_escaped = false;
+  bool after_atom = false;
+  for (uint32_t i = 0; i < input.size(); ++i) {
+    const char c = input[i];
+    const bool is_quote = c == '"' && !is_escaped;
+    is_escaped = !is_escaped && c == '\\';
+    if (in_string) {
+      if (is_quote) {
+        index.push_back(i);
+        in_string = false;
+      }
+      continue;
+    }
+    const bool is_operator =
+        std::string_view("{}[]:,").find(c) != std::string_view::npos;
+    const bool is_atom = !is_operator && !is_quote &&
+                         std::string_view(" \t\n\r").find(c) ==
+                             std::string_view::npos;
+    if (is_operator || is_quote || (is_atom && !after_atom)) {
+      index.push_back(i);
+    }
+    in_string = is_quote;
+    after_atom = is_atom;
+  }
+  return index;
+}
+
+void TestStructuralIndexImplementationsAgree() {
+  std::mt19937 generator(42);
+  const std::string_view alphabet = "{}[]:, \n\"\\\\\\ab12.-";
+  for (int test = 0; test < 200; ++test) {
+    std::string input(generator() % 300, ' ');
+    for (char& c : input) {
+      c = alphabet[generator() % alphabet.size()];
+    }
+    const auto expected = BuildStructuralIndexNaive(input);
+    for (const auto implementation :
+         {JsonView::IndexImplementation::SCALAR,
+          JsonView::IndexImplementation::SSE2,
+          JsonView::IndexImplementation::AVX2}) {
+      ASSERT(JsonView::BuildStructuralIndex(input, implementation) ==
+             expected);
+    }
+  }
+}
+
+void TestLatencyHistogramQuantiles() {
+  using Histogram = Profile::LatencyHistogram;
+  for (uint64_t value : {0ull, 1ull, 15ull, 16ull, 17ull, 1000ull, 123456789ull,
+                         ~0ull}) {
+    const size_t bucket_idx = Histogram::GetBucketIdx(value);
+    ASSERT(Histogram::GetBucketLowerBound(bucket_idx) <= value);
+    ASSERT(value - Histogram::GetBucketLowerBound(bucket_idx) <= value / 16);
+  }
+
+  Histogram histogram;
+  ASSERT_EQUAL(histogram.GetValueAtQuantile(0.5), 0u);
+  for (uint64_t value = 1; value <= 1000; ++value) {
+    histogram.Record(value * 1000);
+  }
+  ASSERT_EQUAL(histogram.GetCount(), 1000u);
+  ASSERT_EQUAL(histogram.GetMax(), 1000000u);
+  ASSERT_EQUAL(histogram.GetMean(), 500500.0);
+  for (const double quantile : {0.5, 0.9, 0.99}) {
+    const double expected = quantile * 1000000;
+    const double actual = histogram.GetValueAtQuantile(quantile);
+    ASSERT(actual >= expected && actual <= expected * 17 / 16);
+  }
+  ASSERT_EQUAL(histogram.GetValueAtQuantile(1.0), 1000000u);
+}
+
+void TestServeNewlineDelimited() {
+  std::stringstream input{kPartEFirstRequest.data()};
+  const auto input_doc = Json::Load(input);
+  const auto& input_map = input_doc.GetRoot().AsMap();
+  const auto& stat_requests = input_map.at("stat_requests").AsArray();
+  const CatalogHolder holder(CatalogHolder::Build(input_map));
+
+  OutputBuffer expected;
+  Requests::ProcessAll(*holder.Acquire(), stat_requests, expected);
+
+  std::stringstream requests{};
+  for (const auto& request : stat_requests) {
+    Json::PrintNode(request, requests);
+    requests << "\n\n";
+  }
+  requests << R"({"id": 7, "type": "Train"})" << '\n';
+  std::stringstream output{};
+  RequestServer(holder, 2).Serve(requests, output);
+
+  std::vector<std::string> lines;
+  for (std::string line; std::getline(output, line);) {
+    lines.push_back(line);
+  }
+  ASSERT_EQUAL(lines.size(), stat_requests.size() + 1);
+  ASSERT_EQUAL(lines.back(),
+               R"({"error_message": "unknown request type: Train"})");
+  std::string joined = "[";
+  for (size_t i = 0; i + 1 < lines.size(); ++i) {
+    joined += (i > 0 ? ", " : "") + lines[i];
+  }
+  joined += "]";
+  ASSERT_EQUAL(joined, expected.View());
+}
+
+void TestParseRequestKeepsRequestKeys() {
+  const Json::Dict request = Requests::ParseRequest(
+      R"({"id": 3, "type": "Stop", "name": "A", "junk": [1, {"x": 2}],)"
+      R"( "nested": {"name": "B"}, "radius": 1.5, "name": "C"})");
+  ASSERT_EQUAL(request.size(), 4u);
+  ASSERT_EQUAL(request.at("id").AsInt(), 3);
+  ASSERT_EQUAL(request.at("name").AsString(), "A");
+  ASSERT_EQUAL(request.at("radius").AsDouble(), 1.5);
+  ASSERT_EQUAL(request.count("junk"), 0u);
+
+  bool is_rejected = false;
+  try {
+    Requests::ParseRequest(R"([{"id": 3}])");
+  } catch (const std::invalid_argument&) {
+    is_rejected = true;
+  }
+  ASSERT(is_rejected);
+}
+
 }  // namespace
 
 void RunTests() {
@@ -516,5 +1346,36 @@ void RunTests() {
   RUN_TEST(tr, CourseraSvgExample);
   RUN_TEST(tr, CourseraPartEFirstCase);
   RUN_TEST(tr, TestJsonEscape);
+  RUN_TEST(tr, TestJsonEscapeRoundTrip);
+  RUN_TEST(tr, TestJsonDictKeepsFirstKey);
+  RUN_TEST(tr, TestJsonKeysInterned);
+  RUN_TEST(tr, TestJsonNumbers);
+  RUN_TEST(tr, TestSaxMatchesLoad);
+  RUN_TEST(tr, TestSaxFieldSet);
+  RUN_TEST(tr, TestCborRoundTrip);
+  RUN_TEST(tr, TestCborResponsesMatchJson);
   RUN_TEST(tr, CourseraPartHFirstCase);
+  RUN_TEST(tr, TestParallelForCoversRange);
+  RUN_TEST(tr, TestCatalogHolderRefresh);
+  RUN_TEST(tr, TestPrecomputedResponses);
+  RUN_TEST(tr, TestSpatialIndexMatchesBruteForce);
+  RUN_TEST(tr, TestNearestStopsRejectsNegativeCount);
+  RUN_TEST(tr, TestStreamingInput);
+  RUN_TEST(tr, TestDistanceTableFallsBackToReverse);
+  RUN_TEST(tr, TestDistanceTableSkipsUnknownStops);
+  RUN_TEST(tr, TestParallelPartitionMatchesSequential);
+  RUN_TEST(tr, TestParallelDescriptions);
+  RUN_TEST(tr, TestConsumingDescriptions);
+  RUN_TEST(tr, TestReadWorkerCountClamps);
+  RUN_TEST(tr, TestParallelRequestsKeepOrder);
+  RUN_TEST(tr, TestDuplicateRequestsCoalesced);
+  RUN_TEST(tr, TestNearDuplicateRequestsKeptApart);
+  RUN_TEST(tr, TestProcessStreamMatchesProcessAll);
+  RUN_TEST(tr, TestJsonViewMatchesJson);
+  RUN_TEST(tr, TestJsonViewLazyMatchesEager);
+  RUN_TEST(tr, TestParallelLoadMatchesLoad);
+  RUN_TEST(tr, TestStructuralIndexImplementationsAgree);
+  RUN_TEST(tr, TestLatencyHistogramQuantiles);
+  RUN_TEST(tr, TestServeNewlineDelimited);
+  RUN_TEST(tr, TestParseRequestKeepsRequestKeys);
 }
@@ -0,0 +1,41 @@
+#include "thread_pool.h"
+
+using namespace std;
+
+ThreadPool::ThreadPool(size_t thread_count) {
+  threads_.reserve(thread_count);
+  for (size_t i = 0; i < max<size_t>(thread_count, 1); ++i) {
+    threads_.emplace_back([this] { Work(); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    lock_guard lock(mutex_);
+    stopped_ = true;
+  }
+  tasks_cv_.notify_all();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+size_t ThreadPool::GetDefaultThreadCount() {
+  return max<size_t>(thread::hardware_concurrency(), 1);
+}
+
+void ThreadPool::Work() {
+  while (true) {
+    function<void()> task;
+    {
+      unique_lock lock(mutex_);
+      tasks_cv_.wait(lock, [this] { return stopped_ || !tasks_.empty(); });
+      if (tasks_.empty()) {
+        return;
+      }
+      task = move(tasks_.front());
+      tasks_.pop();
+    }
+    task();
+  }
+}
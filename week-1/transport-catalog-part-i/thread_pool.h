@@ -0,0 +1,200 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+class ThreadPool {
+ public:
+  explicit ThreadPool(size_t thread_count = GetDefaultThreadCount());
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  static size_t GetDefaultThreadCount();
+
+  size_t GetThreadCount() const { return threads_.size(); }
+
+  // Tasks must not wait for other tasks of the same pool:
+  // with every worker blocked such a wait never finishes
+  template <typename Func>
+  std::future<std::invoke_result_t<Func>> Submit(Func func);
+
+ private:
+  void Work();
+
+  std::mutex mutex_;
+  std::condition_variable tasks_cv_;
+  std::queue<std::function<void()>> tasks_;
+  bool stopped_ = false;
+  std::vector<std::thread> threads_;
+};
+
+template <typename Func>
+std::future<std::invoke_result_t<Func>> ThreadPool::Submit(Func func) {
+  using Result = std::invoke_result_t<Func>;
+  // std::function requires copyable callables, packaged_task is move-only
+  auto task = std::make_shared<std::packaged_task<Result()>>(std::move(func));
+  auto result = task->get_future();
+  {
+    std::lock_guard lock(mutex_);
+    tasks_.push([task] { (*task)(); });
+  }
+  tasks_cv_.notify_one();
+  return result;
+}
+
+template <typename Future>
+void WaitAll(std::vector<Future>& futures) {
+  // get() rethrows the first exception, but only after everything is done:
+  // tasks may still reference the caller's locals
+  for (auto& future : futures) {
+    future.wait();
+  }
+  for (auto& future : futures) {
+    future.get();
+  }
+}
+
+// Splits [0, count) into at most range_count contiguous non-empty ranges
+inline std::vector<std::pair<size_t, size_t>> SplitRanges(size_t count,
+                                                          size_t range_count) {
+  range_count = std::max<size_t>(1, std::min(count, range_count));
+  const size_t range_size = (count + range_count - 1) / range_count;
+
+  std::vector<std::pair<size_t, size_t>> ranges;
+  ranges.reserve(range_count);
+  for (size_t begin = 0; begin < count; begin += range_size) {
+    ranges.emplace_back(begin, std::min(count, begin + range_size));
+  }
+  return ranges;
+}
+
+// Submits func(begin, end) for every range of [0, count), one per worker
+template <typename Func>
+std::vector<std::future<void>> SubmitRanges(ThreadPool& pool, size_t count,
+                                            Func func) {
+  std::vector<std::future<void>> futures;
+  for (const auto& range : SplitRanges(count, pool.GetThreadCount())) {
+    futures.push_back(pool.Submit(
+        [func, begin = range.first, end = range.second] { func(begin, end); }));
+  }
+  return futures;
+}
+
+template <typename Func>
+void ParallelFor(ThreadPool& pool, size_t count, Func func) {
+  auto futures = SubmitRanges(pool, count, std::move(func));
+  WaitAll(futures);
+}
+
+// Hands [0, count) out in chunks to whichever worker is free first,
+// so that a few expensive items do not leave the other workers idle
+template <typename Func>
+void ParallelForDynamic(ThreadPool& pool, size_t count, size_t chunk_size,
+                        Func func) {
+  std::atomic<size_t> next_begin = 0;
+  std::vector<std::future<void>> futures;
+  for (size_t i = 0; i < pool.GetThreadCount(); ++i) {
+    futures.push_back(pool.Submit([&] {
+      for (size_t begin; (begin = next_begin.fetch_add(chunk_size)) < count;) {
+        func(begin, std::min(count, begin + chunk_size));
+      }
+    }));
+  }
+  WaitAll(futures);
+}
+
+// Parallel std::partition, producing exactly the same permutation:
+// the i-th unmatched item before the partition point is swapped
+// with the i-th matched item after it, counting from the end.
+// Routes of equal time are told apart by the order of stops,
+// so the catalog output depends on that permutation.
+template <typename T, typename Predicate>
+typename std::vector<T>::iterator ParallelPartition(ThreadPool& pool,
+                                                    std::vector<T>& items,
+                                                    Predicate predicate) {
+  const auto ranges = SplitRanges(items.size(), pool.GetThreadCount());
+  const auto for_each_range = [&pool, &ranges](auto func) {
+    std::vector<std::future<void>> futures;
+    for (size_t range_idx = 0; range_idx < ranges.size(); ++range_idx) {
+      futures.push_back(pool.Submit([&func, &ranges, range_idx] {
+        func(range_idx, ranges[range_idx].first, ranges[range_idx].second);
+      }));
+    }
+    WaitAll(futures);
+  };
+
+  std::vector<char> is_matched(items.size());
+  std::vector<size_t> matched_counts(ranges.size());
+  for_each_range([&](size_t range_idx, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      is_matched[i] = predicate(items[i]);
+      matched_counts[range_idx] += is_matched[i];
+    }
+  });
+  size_t partition_point = 0;
+  for (const size_t matched_count : matched_counts) {
+    partition_point += matched_count;
+  }
+
+  // misplaced items: unmatched on the left, matched on the right
+  std::vector<size_t> left_counts(ranges.size());
+  std::vector<size_t> right_counts(ranges.size());
+  for_each_range([&](size_t range_idx, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      if (i < partition_point && !is_matched[i]) {
+        ++left_counts[range_idx];
+      } else if (i >= partition_point && is_matched[i]) {
+        ++right_counts[range_idx];
+      }
+    }
+  });
+  std::vector<size_t> left_offsets(ranges.size());
+  std::vector<size_t> right_offsets(ranges.size());
+  size_t misplaced_count = 0;
+  for (size_t range_idx = 0; range_idx < ranges.size(); ++range_idx) {
+    left_offsets[range_idx] = misplaced_count;
+    misplaced_count += left_counts[range_idx];
+  }
+  for (size_t range_idx = ranges.size(), offset = 0; range_idx > 0;
+       --range_idx) {
+    right_offsets[range_idx - 1] = offset;
+    offset += right_counts[range_idx - 1];
+  }
+
+  std::vector<size_t> left_positions(misplaced_count);
+  std::vector<size_t> right_positions(misplaced_count);
+  for_each_range([&](size_t range_idx, size_t begin, size_t end) {
+    size_t left_idx = left_offsets[range_idx];
+    size_t right_idx = right_offsets[range_idx];
+    for (size_t i = begin; i < end; ++i) {
+      if (i < partition_point && !is_matched[i]) {
+        left_positions[left_idx++] = i;
+      }
+    }
+    for (size_t i = end; i > begin; --i) {
+      if (i - 1 >= partition_point && is_matched[i - 1]) {
+        right_positions[right_idx++] = i - 1;
+      }
+    }
+  });
+
+  ParallelFor(pool, misplaced_count, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      std::swap(items[left_positions[i]], items[right_positions[i]]);
+    }
+  });
+
+  return items.begin() + partition_point;
+}
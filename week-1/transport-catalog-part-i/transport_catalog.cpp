@@ -2,12 +2,19 @@
 
 #include <sstream>
 
+#include "distance_table.h"
+#include "profile.h"
+
 using namespace std;
 
 TransportCatalog::TransportCatalog(vector<Descriptions::InputQuery> data,
                                    const Json::Dict& routing_settings_json,
-                                   const Json::Dict& render_settings_json) {
-  auto stops_end = partition(begin(data), end(data), [](const auto& item) {
+                                   const Json::Dict& render_settings_json,
+                                   const Json::Dict& serving_settings_json,
+                                   ThreadPool& pool) {
+  // Every task below is waited for by WaitAll before it returns or throws,
+  // so the pool may outlive the locals they reference
+  auto stops_end = ParallelPartition(pool, data, [](const auto& item) {
     return holds_alternative<Descriptions::Stop>(item);
   });
 
@@ -19,25 +26,78 @@ TransportCatalog::TransportCatalog(vector<Descriptions::InputQuery> data,
   }
 
   Descriptions::BusesDict buses_dict;
+  vector<const Descriptions::Bus*> buses;
+  buses.reserve(distance(stops_end, end(data)));
   for (const auto& item : Range{stops_end, end(data)}) {
     const auto& bus = get<Descriptions::Bus>(item);
-
     buses_dict[bus.name] = &bus;
-    buses_[bus.name] =
-        Bus{bus.stops.size(), ComputeUniqueItemsCount(AsRange(bus.stops)),
-            ComputeRoadRouteLength(bus.stops, stops_dict),
-            ComputeGeoRouteDistance(bus.stops, stops_dict)};
+    buses.push_back(&bus);
+  }
+
+  const DistanceTable distances(stops_dict);
 
+  // Stats, router and renderer only read the dicts above,
+  // so all of them are built concurrently
+  vector<Bus> bus_stats(buses.size());
+  auto futures =
+      SubmitRanges(pool, buses.size(), [&](size_t begin, size_t end) {
+        Profile::PhaseTimer timer("stats");
+        for (size_t i = begin; i < end; ++i) {
+          const auto& stops = buses[i]->stops;
+          bus_stats[i] = Bus{
+              .stop_count = stops.size(),
+              .unique_stop_count = ComputeUniqueItemsCount(AsRange(stops)),
+              .road_route_length = ComputeRoadRouteLength(stops, distances),
+              .geo_route_length = ComputeGeoRouteDistance(stops, stops_dict),
+              // see PrecomputeResponses
+              .serialized = nullopt,
+          };
+        }
+      });
+  futures.push_back(pool.Submit([&] {
+    router_ = make_unique<TransportRouter>(stops_dict, buses_dict, distances,
+                                           routing_settings_json);
+  }));
+  futures.push_back(pool.Submit([&] {
+    Profile::PhaseTimer timer("render");
+    renderer_ =
+        make_unique<Renderer>(stops_dict, buses_dict, render_settings_json);
+  }));
+  futures.push_back(pool.Submit(
+      [&] { stops_index_ = make_unique<SpatialIndex>(stops_dict); }));
+  WaitAll(futures);
+
+  for (size_t i = 0; i < buses.size(); ++i) {
+    const auto& bus = *buses[i];
+    buses_[bus.name] = bus_stats[i];
     for (const string& stop_name : bus.stops) {
       stops_.at(stop_name).bus_names.insert(bus.name);
     }
   }
 
-  router_ = make_unique<TransportRouter>(stops_dict, buses_dict,
-                                         routing_settings_json);
-  renderer_ =
-      make_unique<Renderer>(stops_dict, buses_dict, render_settings_json);
-  //  std::cout << "GetResult: " << renderer_->GetResult() << endl;
+  if (MakeServingSettings(serving_settings_json).precompute_responses) {
+    PrecomputeResponses();
+  }
+}
+
+TransportCatalog::ServingSettings TransportCatalog::MakeServingSettings(
+    const Json::Dict& json) {
+  ServingSettings settings;
+  if (json.count("precompute_responses") > 0) {
+    settings.precompute_responses = json.at("precompute_responses").AsBool();
+  }
+  return settings;
+}
+
+void TransportCatalog::PrecomputeResponses() {
+  for (auto& [_, stop] : stops_) {
+    stop.serialized.emplace(
+        [&stop](Json::Writer& writer) { stop.Write(writer, nullopt); });
+  }
+  for (auto& [_, bus] : buses_) {
+    bus.serialized.emplace(
+        [&bus](Json::Writer& writer) { bus.Write(writer, nullopt); });
+  }
 }
 
 const TransportCatalog::Stop* TransportCatalog::GetStop(
@@ -55,12 +115,12 @@ optional<TransportRouter::RouteInfo> TransportCatalog::FindRoute(
   return router_->FindRoute(stop_from, stop_to);
 }
 
-int TransportCatalog::ComputeRoadRouteLength(
-    const vector<string>& stops, const Descriptions::StopsDict& stops_dict) {
+int TransportCatalog::ComputeRoadRouteLength(const vector<string>& stops,
+                                             const DistanceTable& distances) {
+  const auto stop_ids = distances.GetStopIds(stops);
   int result = 0;
-  for (size_t i = 1; i < stops.size(); ++i) {
-    result += Descriptions::ComputeStopsDistance(*stops_dict.at(stops[i - 1]),
-                                                 *stops_dict.at(stops[i]));
+  for (size_t i = 1; i < stop_ids.size(); ++i) {
+    result += distances.Get(stop_ids[i - 1], stop_ids[i]);
   }
   return result;
 }
@@ -75,6 +135,53 @@ double TransportCatalog::ComputeGeoRouteDistance(
   return result;
 }
 
+void Responses::WriteRequestId(Json::Writer& writer,
+                               optional<int> request_id) {
+  writer.Key("request_id");
+  if (request_id) {
+    writer.Value(*request_id);
+  } else {
+    writer.Gap();
+  }
+}
+
+// Keys go in the sorted order of Json::Dict
+void Responses::Stop::Write(Json::Writer& writer,
+                            optional<int> request_id) const {
+  writer.BeginObject().Key("buses").BeginArray();
+  for (const auto& bus_name : bus_names) {
+    writer.Value(bus_name);
+  }
+  writer.EndArray();
+  WriteRequestId(writer, request_id);
+  writer.EndObject();
+}
+
+void Responses::Bus::Write(Json::Writer& writer,
+                           optional<int> request_id) const {
+  writer.BeginObject()
+      .Key("curvature")
+      .Value(road_route_length / geo_route_length);
+  WriteRequestId(writer, request_id);
+  writer.Key("route_length")
+      .Value(road_route_length)
+      .Key("stop_count")
+      .Value(static_cast<int>(stop_count))
+      .Key("unique_stop_count")
+      .Value(static_cast<int>(unique_stop_count))
+      .EndObject();
+}
+
 std::string TransportCatalog::RenderMap() const {
   return renderer_->GetResult();
 }
+
+vector<SpatialIndex::Neighbour> TransportCatalog::FindNearestStops(
+    Sphere::Point position, size_t count) const {
+  return stops_index_->FindNearest(position, count);
+}
+
+vector<SpatialIndex::Neighbour> TransportCatalog::FindStopsInRadius(
+    Sphere::Point position, double radius) const {
+  return stops_index_->FindInRadius(position, radius);
+}
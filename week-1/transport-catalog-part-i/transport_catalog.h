@@ -8,14 +8,24 @@
 #include <vector>
 
 #include "descriptions.h"
+#include "distance_table.h"
 #include "json.h"
 #include "renderer.h"
+#include "spatial_index.h"
+#include "thread_pool.h"
 #include "transport_router.h"
 #include "utils.h"
 
 namespace Responses {
+// Without request_id leaves a gap for it, see Json::Template
+void WriteRequestId(Json::Writer& writer, std::optional<int> request_id);
+
 struct Stop {
   std::set<std::string> bus_names;
+  // response printed at build time, with a gap for request_id
+  std::optional<Json::Template> serialized;
+
+  void Write(Json::Writer& writer, std::optional<int> request_id) const;
 };
 
 struct Bus {
@@ -23,6 +33,9 @@ struct Bus {
   size_t unique_stop_count = 0;
   int road_route_length = 0;
   double geo_route_length = 0.0;
+  std::optional<Json::Template> serialized;
+
+  void Write(Json::Writer& writer, std::optional<int> request_id) const;
 };
 }  // namespace Responses
 
@@ -32,9 +45,11 @@ class TransportCatalog {
   using Stop = Responses::Stop;
 
  public:
+  // Stats, router and renderer are built by the pool workers
   TransportCatalog(std::vector<Descriptions::InputQuery> data,
                    const Json::Dict& routing_settings_json,
-                   const Json::Dict& render_settings_json);
+                   const Json::Dict& render_settings_json,
+                   const Json::Dict& serving_settings_json, ThreadPool& pool);
 
   const Stop* GetStop(const std::string& name) const;
   const Bus* GetBus(const std::string& name) const;
@@ -44,9 +59,22 @@ class TransportCatalog {
 
   std::string RenderMap() const;
 
+  std::vector<SpatialIndex::Neighbour> FindNearestStops(
+      Sphere::Point position, size_t count) const;
+  std::vector<SpatialIndex::Neighbour> FindStopsInRadius(
+      Sphere::Point position, double radius) const;
+
  private:
+  struct ServingSettings {
+    bool precompute_responses = false;
+  };
+
+  static ServingSettings MakeServingSettings(const Json::Dict& json);
+
+  void PrecomputeResponses();
+
   static int ComputeRoadRouteLength(const std::vector<std::string>& stops,
-                                    const Descriptions::StopsDict& stops_dict);
+                                    const DistanceTable& distances);
 
   static double ComputeGeoRouteDistance(
       const std::vector<std::string>& stops,
@@ -56,4 +84,5 @@ class TransportCatalog {
   std::unordered_map<std::string, Bus> buses_;
   std::unique_ptr<TransportRouter> router_;
   std::unique_ptr<Renderer> renderer_;
+  std::unique_ptr<SpatialIndex> stops_index_;
 };
@@ -1,18 +1,25 @@
 #include "transport_router.h"
 
+#include "profile.h"
+
 using namespace std;
 
 TransportRouter::TransportRouter(const Descriptions::StopsDict& stops_dict,
                                  const Descriptions::BusesDict& buses_dict,
+                                 const DistanceTable& distances,
                                  const Json::Dict& routing_settings_json)
     : routing_settings_(MakeRoutingSettings(routing_settings_json)) {
-  const size_t vertex_count = stops_dict.size() * 2;
-  vertices_info_.resize(vertex_count);
-  graph_ = BusGraph(vertex_count);
+  {
+    Profile::PhaseTimer timer("graph_build");
+    const size_t vertex_count = stops_dict.size() * 2;
+    vertices_info_.resize(vertex_count);
+    graph_ = BusGraph(vertex_count);
 
-  FillGraphWithStops(stops_dict);
-  FillGraphWithBuses(stops_dict, buses_dict);
+    FillGraphWithStops(stops_dict);
+    FillGraphWithBuses(buses_dict, distances);
+  }
 
+  Profile::PhaseTimer timer("router_build");
   router_ = std::make_unique<Router>(graph_);
 }
 
@@ -46,18 +53,17 @@ void TransportRouter::FillGraphWithStops(
 }
 
 void TransportRouter::FillGraphWithBuses(
-    const Descriptions::StopsDict& stops_dict,
-    const Descriptions::BusesDict& buses_dict) {
+    const Descriptions::BusesDict& buses_dict,
+    const DistanceTable& distances) {
   for (const auto& [_, bus_item] : buses_dict) {
     const auto& bus = *bus_item;
     const size_t stop_count = bus.stops.size();
     if (stop_count <= 1) {
       continue;
     }
-    auto compute_distance_from = [&stops_dict, &bus](size_t lhs_idx) {
-      return Descriptions::ComputeStopsDistance(
-          *stops_dict.at(bus.stops[lhs_idx]),
-          *stops_dict.at(bus.stops[lhs_idx + 1]));
+    const auto stop_ids = distances.GetStopIds(bus.stops);
+    auto compute_distance_from = [&distances, &stop_ids](size_t lhs_idx) {
+      return distances.Get(stop_ids[lhs_idx], stop_ids[lhs_idx + 1]);
     };
     for (size_t start_stop_idx = 0; start_stop_idx + 1 < stop_count;
          ++start_stop_idx) {
@@ -87,15 +93,15 @@ optional<TransportRouter::RouteInfo> TransportRouter::FindRoute(
     const string& stop_from, const string& stop_to) const {
   const Graph::VertexId vertex_from = stops_vertex_ids_.at(stop_from).out;
   const Graph::VertexId vertex_to = stops_vertex_ids_.at(stop_to).out;
-  const auto route = router_->BuildRoute(vertex_from, vertex_to);
+  // concurrent requests share the router, so its route cache is bypassed
+  const auto route = router_->BuildExpandedRoute(vertex_from, vertex_to);
   if (!route) {
     return nullopt;
   }
 
   RouteInfo route_info = {.total_time = route->weight};
-  route_info.items.reserve(route->edge_count);
-  for (size_t edge_idx = 0; edge_idx < route->edge_count; ++edge_idx) {
-    const Graph::EdgeId edge_id = router_->GetRouteEdge(route->id, edge_idx);
+  route_info.items.reserve(route->edges.size());
+  for (const Graph::EdgeId edge_id : route->edges) {
     const auto& edge = graph_.GetEdge(edge_id);
     const auto& edge_info = edges_info_[edge_id];
     if (holds_alternative<BusEdgeInfo>(edge_info)) {
@@ -114,8 +120,5 @@ optional<TransportRouter::RouteInfo> TransportRouter::FindRoute(
     }
   }
 
-  // Releasing in destructor of some proxy object would be better,
-  // but we do not expect exceptions in normal workflow
-  router_->ReleaseRoute(route->id);
   return route_info;
 }
@@ -5,6 +5,7 @@
 #include <vector>
 
 #include "descriptions.h"
+#include "distance_table.h"
 #include "graph.h"
 #include "json.h"
 #include "router.h"
@@ -17,6 +18,7 @@ class TransportRouter {
  public:
   TransportRouter(const Descriptions::StopsDict& stops_dict,
                   const Descriptions::BusesDict& buses_dict,
+                  const DistanceTable& distances,
                   const Json::Dict& routing_settings_json);
 
   struct RouteInfo {
@@ -49,8 +51,8 @@ class TransportRouter {
 
   void FillGraphWithStops(const Descriptions::StopsDict& stops_dict);
 
-  void FillGraphWithBuses(const Descriptions::StopsDict& stops_dict,
-                          const Descriptions::BusesDict& buses_dict);
+  void FillGraphWithBuses(const Descriptions::BusesDict& buses_dict,
+                          const DistanceTable& distances);
 
   struct StopVertexIds {
     Graph::VertexId in;